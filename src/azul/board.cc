@@ -1,21 +1,46 @@
 #include "board.h"
 #include "magics.h"
+#include "zobrist.h"
 
 #include <algorithm>
 
-// masks for all tiles bonusses
-static const uint32_t kAllTiles[] = {0x1041041, 0x182082, 0x20c104, 0x410608,
-                                     0x820830};
+static_assert(zobrist::kMaxFloorline >=
+                  CenterT<kMaxPlayers>::NUM_FACTORIES *
+                          CenterT<kMaxPlayers>::NUM_TILES_PER_FACTORY +
+                      1,
+              "floorline keys must cover every tile of a round");
+
+struct LineTables {
+  // placements blocked by the tiles on a wall row, indexed by [row][row bits]
+  uint32_t blocked[Board::SIZE][1 << Board::SIZE];
+  // all placements on a line
+  uint32_t line[Board::SIZE];
+  // all placements, including the floorline which is always available
+  uint32_t all;
+};
+
+static constexpr LineTables MakeLineTables() {
+  LineTables t{};
+  for (int row = 0; row < Board::SIZE; row++) {
+    t.line[row] = Board::LineBits(row);
+    t.all |= t.line[row];
+    for (int bits = 0; bits < (1 << Board::SIZE); bits++) {
+      for (int col = 0; col < Board::SIZE; col++) {
+        if (bits & (1 << col)) {
+          int tile = (col - row + Board::SIZE) % Board::SIZE;
+          t.blocked[row][bits] |= 1u << Board::LineBit(tile, row);
+        }
+      }
+    }
+  }
+  t.all |= Board::LineBits(FLOORLINE);
+  return t;
+}
 
-// floorline penalties
-static const int kPenalty[] = {0, 1, 2, 4, 6, 8, 11, 14};
-static const int kFloorLineSize = 7;
-static const int kBonusTiles = 10;
-static const int kBonusCol = 7;
-static const int kBonusRow = 2;
+static constexpr LineTables kLineTables = MakeLineTables();
 
-Board::Board(Bag &bag)
-    : wall(0), floorline(0), score_(0), terminal_(false), bag_(bag) {
+Board::Board(int player)
+    : wall(0), floorline(0), score_(0), terminal_(false), player_(player) {
   Reset();
 }
 
@@ -29,26 +54,35 @@ void Board::Reset() {
   terminal_ = false;
 }
 
-void Board::ApplyMove(Move move, int num_tiles) {
+void Board::ApplyMove(Move move, int num_tiles, Bag &bag, uint64_t &hash) {
   // apply move to the "left" part
   if (move.line < SIZE) {
-    left[move.line].tile_type = move.tile_type;
-    left[move.line].count += num_tiles;
+    LLine &l = left[move.line];
+    hash ^= zobrist::Left(player_, move.line, l.tile_type, l.count);
+    l.tile_type = move.tile_type;
+    l.count += num_tiles;
     num_tiles = 0;
     // line is saturated
-    if (left[move.line].count > move.line + 1) {
-      num_tiles = left[move.line].count - (move.line + 1);
-      left[move.line].count = move.line + 1;
+    if (l.count > move.line + 1) {
+      num_tiles = l.count - (move.line + 1);
+      l.count = move.line + 1;
     }
+    hash ^= zobrist::Left(player_, move.line, l.tile_type, l.count);
   }
 
   // put remaining tiles on the floorline
+  hash ^= zobrist::Floorline(player_, floorline);
   floorline += num_tiles;
+  hash ^= zobrist::Floorline(player_, floorline);
   // update bag statistics
-  bag_.Return(Tile(move.tile_type), num_tiles);
+  bag.Return(Tile(move.tile_type), num_tiles);
 }
 
-void Board::IncreaseFloorline() { floorline++; }
+void Board::IncreaseFloorline(uint64_t &hash) {
+  hash ^= zobrist::Floorline(player_, floorline) ^
+          zobrist::Floorline(player_, floorline + 1);
+  floorline++;
+}
 
 void Board::UpdateScore(int row, int col, int tile) {
   // NOTE: Uses magic bitboards to determine row + column score
@@ -63,8 +97,6 @@ void Board::UpdateScore(int row, int col, int tile) {
   score_ += (wall & kAllTiles[tile]) == kAllTiles[tile] ? kBonusTiles : 0;
 }
 
-static uint32_t Column(int row, int tile) { return (row + tile) % Board::SIZE; }
-
 bool Board::WallHasTile(Tile tile, Line line) {
   if (line == FLOORLINE) {
     return false;
@@ -75,18 +107,47 @@ bool Board::WallHasTile(Tile tile, Line line) {
   return wall & (1ul << (row * SIZE + col));
 }
 
-void Board::NextRound() {
+bool Board::CompletesRow() const {
+  for (int i = 0; i < SIZE; i++) {
+    if (left[i].count != i + 1) continue;
+    uint32_t square = 1u << (i * SIZE + Column(i, left[i].tile_type));
+    if (((wall | square) & kRows[i]) == kRows[i]) return true;
+  }
+  return false;
+}
+
+uint32_t Board::LegalLines() const {
+  uint32_t blocked = 0;
+  for (int i = 0; i < SIZE; i++) {
+    blocked |= kLineTables.blocked[i][(wall >> (i * SIZE)) & 0x1f];
+    if (left[i].count == i + 1) {
+      blocked |= kLineTables.line[i];
+    } else if (left[i].count > 0) {
+      blocked |= kLineTables.line[i] & ~(1u << LineBit(left[i].tile_type, i));
+    }
+  }
+  return kLineTables.all & ~blocked;
+}
+
+Board::RoundUndo Board::NextRound(Bag &bag, uint64_t &hash) {
+  RoundUndo undo{score_, floorline, 0, terminal_};
+  hash ^= zobrist::Score(player_, Score());
+  hash ^= zobrist::Floorline(player_, floorline);
+
   // 1. move left to the wall and clear
   // 2. compute score
   // 3. determine if game over
   for (int i = 0; i < SIZE; i++) {
     if (left[i].count == (i + 1)) {
       int j = Column(i, left[i].tile_type);
+      hash ^= zobrist::Left(player_, i, left[i].tile_type, left[i].count);
+      hash ^= zobrist::Wall(player_, i * SIZE + j);
       wall |= (1ul << (i * SIZE + j));
+      undo.lines |= 1 << i;
       UpdateScore(i, j, left[i].tile_type);
 
       // update bag statistics
-      bag_.Return(Tile(left[i].tile_type), left[i].count - 1);
+      bag.Return(Tile(left[i].tile_type), left[i].count - 1);
       left[i].count = 0;
     }
   }
@@ -95,20 +156,34 @@ void Board::NextRound() {
   score_ -= kPenalty[std::min(int(floorline), kFloorLineSize)];
   score_ = std::max(0, int(score_));
   floorline = 0;
+  hash ^= zobrist::Score(player_, Score());
+  return undo;
 }
 
-uint8_t Board::Score() const { return static_cast<uint8_t>(score_); }
-
-Board& Board::operator=(const Board& board) {
-  if (this == &board) {
-    return *this;
+void Board::UndoRound(const RoundUndo &undo) {
+  for (int i = 0; i < SIZE; i++) {
+    if (undo.lines & (1 << i)) {
+      // the tile type of a line is left intact when moved to the wall
+      int j = Column(i, left[i].tile_type);
+      wall &= ~(1ul << (i * SIZE + j));
+      left[i].count = i + 1;
+    }
   }
+  score_ = undo.score;
+  floorline = undo.floorline;
+  terminal_ = undo.terminal;
+}
 
-  score_ = board.score_;
-  terminal_ = board.terminal_;
-  wall = board.wall;
-  floorline = board.floorline;
-  for (int i = 0; i < SIZE; i++) left[i] = board.left[i];
+uint8_t Board::Score() const { return static_cast<uint8_t>(score_); }
 
-  return *this;
+uint64_t Board::Hash() const {
+  uint64_t hash = zobrist::Floorline(player_, floorline);
+  hash ^= zobrist::Score(player_, Score());
+  for (int i = 0; i < SIZE; i++) {
+    hash ^= zobrist::Left(player_, i, left[i].tile_type, left[i].count);
+  }
+  for (int i = 0; i < SIZE * SIZE; i++) {
+    if (wall & (1ul << i)) hash ^= zobrist::Wall(player_, i);
+  }
+  return hash;
 }
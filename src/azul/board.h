@@ -8,6 +8,9 @@
 
 class Board {
  public:
+  friend class GameBatch;
+  template <int kPlayers>
+  friend class StateT;
   static const int SIZE = 5;
 
   // masks for columns
@@ -15,31 +18,72 @@ class Board {
                                           0x842108, 0x1084210};
   // masks for rows
   static constexpr uint32_t kRows[] = {0x1f, 0x3e0, 0x7c00, 0xf8000, 0x1f00000};
+  // masks for all tiles bonusses
+  static constexpr uint32_t kAllTiles[] = {0x1041041, 0x182082, 0x20c104,
+                                           0x410608, 0x820830};
 
-  Board(Bag &bag);
+  // floorline penalties
+  static constexpr int kPenalty[] = {0, 1, 2, 4, 6, 8, 11, 14};
+  static constexpr int kFloorLineSize = 7;
+  static constexpr int kBonusTiles = 10;
+  static constexpr int kBonusCol = 7;
+  static constexpr int kBonusRow = 2;
 
-  // always assumes a legal move
-  void ApplyMove(Move move, int num_tiles);
-  void IncreaseFloorline();
-  void NextRound();
+  // column on the wall of a tile placed on a row
+  static constexpr int Column(int row, int tile) { return (row + tile) % SIZE; }
+  // bit of a (tile, line) placement in the LegalLines() mask
+  static constexpr int LineBit(int tile, int line) {
+    return tile * NUM_LINES + line;
+  }
+  // all placements on a line in the LegalLines() mask
+  static constexpr uint32_t LineBits(int line) {
+    uint32_t bits = 0;
+    for (int tile = 0; tile < NUM_TILES; tile++) {
+      bits |= 1u << LineBit(tile, line);
+    }
+    return bits;
+  }
+
+  // everything NextRound() changes except for the bag, used to undo it
+  struct RoundUndo {
+    int16_t score;
+    uint8_t floorline;
+    uint8_t lines;  ///< pattern lines that were moved to the wall
+    bool terminal;
+  };
+
+  // player determines the zobrist keys used for this board
+  explicit Board(int player = 0);
+
+  // always assumes a legal move, overflowing tiles are returned to the bag
+  void ApplyMove(Move move, int num_tiles, Bag &bag, uint64_t &hash);
+  void IncreaseFloorline(uint64_t &hash);
+  RoundUndo NextRound(Bag &bag, uint64_t &hash);
+  // restores the board to before NextRound(), the hash isn't updated
+  void UndoRound(const RoundUndo &undo);
   void Reset();
   uint8_t Score() const;
   bool IsTerminal() { return terminal_; }
+  // a full pattern line completes a wall row, the game ends with this round
+  bool CompletesRow() const;
   bool WallHasTile(Tile tile, Line line);
-  Board &operator=(const Board &board);
+  // legal (tile, line) placements, 6 bits (one per line) for every tile
+  uint32_t LegalLines() const;
+  uint64_t Hash() const;
 
   struct LLine {
     uint8_t tile_type;
     uint8_t count;
   };
-  LLine left[SIZE];
+  // NOTE: Members are ordered to minimize padding, Board is copied a lot
   uint32_t wall;  ///< using 25 bit for the wall (1 bit per tile)
+  LLine left[SIZE];
   uint8_t floorline;
 
  private:
   int16_t score_;
   bool terminal_;
-  Bag &bag_;
+  uint8_t player_;
 
   void UpdateScore(int row, int col, int tile);
 };
@@ -0,0 +1,83 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <vector>
+
+#include "replay.h"
+#include "state.h"
+#include "utils/random.h"
+
+// Average branching factor before and after State::PruneFloorOverflow().
+// usage: branching <game.azr>...
+//        branching --random [games] [seed]
+//
+// Self-play replays give the positions the search actually meets, random
+// games only serve as a comparison.
+
+struct Counts {
+  int64_t positions{0};
+  int64_t legal{0};
+  int64_t pruned{0};
+
+  void Add(const State &state) {
+    MoveMask mask = state.LegalMask();
+    positions++;
+    legal += mask.Count();
+    pruned += state.PruneFloorOverflow(mask).Count();
+  }
+};
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <game.azr>... | --random [games] [seed]\n",
+            argv[0]);
+    return 1;
+  }
+
+  Counts counts;
+  int games = 0;
+  if (strcmp(argv[1], "--random") == 0) {
+    games = argc > 2 ? atoi(argv[2]) : 1000;
+    uint64_t seed = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1;
+    utils::Random::Get().Seed(seed);
+
+    State state;
+    MoveList moves;
+    for (int g = 0; g < games; g++) {
+      state.Reset();
+      while (!state.IsTerminal()) {
+        counts.Add(state);
+        int n = state.LegalMoves(moves);
+        state.Step(moves[utils::Random::Get().GetInt(0, n - 1)]);
+      }
+    }
+  } else {
+    for (int i = 1; i < argc; i++) {
+      std::ifstream in(argv[i], std::ios::binary);
+      if (!in) {
+        fprintf(stderr, "can't open %s\n", argv[i]);
+        return 1;
+      }
+      Replay replay;
+      std::vector<Replay::Datapoint> records;
+      while (in.peek() != std::char_traits<char>::eof()) {
+        if (!replay.Read(in) || !replay.Expand(&records)) {
+          fprintf(stderr, "%s: game %d is not a replay\n", argv[i], games);
+          return 1;
+        }
+        for (const auto &record : records) counts.Add(record.state);
+        games++;
+      }
+    }
+  }
+
+  printf("%d games, %ld positions\n", games, long(counts.positions));
+  printf("legal  %6.2f moves per position\n",
+         double(counts.legal) / counts.positions);
+  printf("pruned %6.2f moves per position\n",
+         double(counts.pruned) / counts.positions);
+  return 0;
+}
@@ -1,5 +1,6 @@
 #include "center.h"
 #include "utils/random.h"
+#include "zobrist.h"
 
 #include <glog/logging.h>
 #include <algorithm>
@@ -10,6 +11,23 @@
 // ============================================================================
 // Bag class
 // ============================================================================
+// binomial coefficients of every draw from the bag
+struct Binomial {
+  uint64_t c[Bag::BAG_SIZE + 1][Bag::MAX_DRAW + 1];
+
+  constexpr Binomial() : c{} {
+    for (int n = 0; n <= Bag::BAG_SIZE; n++) {
+      c[n][0] = 1;
+      for (int k = 1; k <= Bag::MAX_DRAW && k <= n; k++)
+        c[n][k] = c[n - 1][k - 1] + c[n - 1][k];
+    }
+  }
+
+  uint64_t operator()(int n, int k) const { return c[n][k]; }
+};
+
+static constexpr Binomial kBinomial;
+
 Bag::Bag() : size_(0) { Reset(); }
 
 void Bag::Reset() {
@@ -20,32 +38,99 @@ void Bag::Reset() {
   size_ = BAG_SIZE;
 }
 
-Tile Bag::Pop() {
+Tile Bag::Pop(uint64_t &hash) {
   if (size_ == 0) {
-    ReShuffle();
+    ReShuffle(hash);
   }
 
-  int r = utils::Random::Get().GetInt(0, size_ - 1);
+  int r = utils::Random::Get().GetBounded(size_);
   int sum = 0;
   // roulette wheel selection of a tile
   for (int i = 0; i < NUM_TILES - 1; i++) {
     sum += tiles[i];
     if (r < sum) {
+      hash ^= zobrist::Bag(i, tiles[i]) ^ zobrist::Bag(i, tiles[i] - 1);
       tiles[i]--;
       size_--;
       return Tile(i);
     }
   }
 
-  tiles[NUM_TILES - 1]--;
+  const int last = NUM_TILES - 1;
+  hash ^= zobrist::Bag(last, tiles[last]) ^ zobrist::Bag(last, tiles[last] - 1);
+  tiles[last]--;
   size_--;
-  return Tile(NUM_TILES - 1);
+  return Tile(last);
+}
+
+int Bag::Draw(int n, uint8_t *counts, uint64_t &hash) {
+  return Draw(n, counts, hash, utils::Random::Get().Fast());
 }
 
-void Bag::ReShuffle() {
+int Bag::Draw(int n, uint8_t *counts, uint64_t &hash, utils::Xoshiro256 &rng) {
+  DCHECK(n >= 0 && n <= MAX_DRAW);
+  int drawn = 0;
+  if (size_ < n) {
+    // empty the bag and continue with the returned tiles
+    for (int i = 0; i < NUM_TILES; i++) {
+      hash ^= zobrist::Bag(i, tiles[i]);
+      counts[i] += tiles[i];
+      tiles[i] = 0;
+    }
+    drawn = size_;
+    n -= size_;
+    size_ = 0;
+    ReShuffle(hash);
+    n = std::min<int>(n, size_);
+  }
+
+  // multivariate hypergeometric from a single random number, r picks one of
+  // the C(size, n) equally likely sets of tiles. Every color splits the sets
+  // left into blocks by the nof tiles of its own, m counts the ways to pick
+  // the tiles of the colors already chosen so no division is needed.
+  uint64_t r = rng.Bounded(kBinomial(size_, n));
+  uint64_t m = 1;
+  int rest = size_;
+  for (int i = 0; i < NUM_TILES && n > 0; i++) {
+    rest -= tiles[i];
+    int k = 0;
+    for (;; k++) {
+      const uint64_t w = m * kBinomial(tiles[i], k) * kBinomial(rest, n - k);
+      if (r < w) break;
+      r -= w;
+    }
+    m *= kBinomial(tiles[i], k);
+
+    if (k == 0) continue;
+    hash ^= zobrist::Bag(i, tiles[i]) ^ zobrist::Bag(i, tiles[i] - k);
+    tiles[i] -= k;
+    counts[i] += k;
+    size_ -= k;
+    drawn += k;
+    n -= k;
+  }
+  return drawn;
+}
+
+void Bag::Remove(const uint8_t *counts, uint64_t &hash) {
+  int n = 0;
+  for (int i = 0; i < NUM_TILES; i++) n += counts[i];
+  // Draw() only reshuffles once the bag can't serve a draw
+  if (n > size_) ReShuffle(hash);
+
+  for (int i = 0; i < NUM_TILES; i++) {
+    hash ^= zobrist::Bag(i, tiles[i]) ^ zobrist::Bag(i, tiles[i] - counts[i]);
+    tiles[i] -= counts[i];
+    size_ -= counts[i];
+  }
+}
+
+void Bag::ReShuffle(uint64_t &hash) {
   size_ = 0;
   for (int i = 0; i < NUM_TILES; i++) {
+    hash ^= zobrist::Bag(i, tiles[i]);
     tiles[i] += returned_[i];
+    hash ^= zobrist::Bag(i, tiles[i]);
     size_ += tiles[i];
     returned_[i] = 0;
   }
@@ -53,18 +138,10 @@ void Bag::ReShuffle() {
 
 void Bag::Return(Tile tile, int num) { returned_[tile] += num; }
 
-Bag& Bag::operator=(const Bag& bag) {
-  if (this == &bag) {
-    return *this;
-  }
-
-  size_ = bag.size_;
-  for (int i = 0; i < NUM_TILES; i++) {
-    tiles[i] = bag.tiles[i];
-    returned_[i] = bag.returned_[i];
-  }
-
-  return *this;
+uint64_t Bag::Hash() const {
+  uint64_t hash = 0;
+  for (int i = 0; i < NUM_TILES; i++) hash ^= zobrist::Bag(i, tiles[i]);
+  return hash;
 }
 
 // ============================================================================
@@ -72,6 +149,14 @@ Bag& Bag::operator=(const Bag& bag) {
 // ============================================================================
 Holder::Holder() { Clear(); }
 
+uint64_t Holder::Hash(Position pos) const {
+  uint64_t hash = 0;
+  for (int i = 0; i < NUM_TILES; i++) {
+    hash ^= zobrist::Holder(pos, i, counts_[i]);
+  }
+  return hash;
+}
+
 int Holder::Add(Tile tile, int num) {
   counts_[tile] += num;
   return counts_[tile];
@@ -87,6 +172,12 @@ void Holder::Clear() { for (int i = 0; i < NUM_TILES; i++) counts_[i] = 0; }
 
 int Holder::Count(Tile tile) { return counts_[tile]; }
 
+uint32_t Holder::Present() const {
+  uint32_t mask = 0;
+  for (int i = 0; i < NUM_TILES; i++) mask |= (counts_[i] > 0) << i;
+  return mask;
+}
+
 int Holder::Count() {
   int sum = 0;
   for (int i = 0; i < NUM_TILES; i++) {
@@ -95,22 +186,20 @@ int Holder::Count() {
   return sum;
 }
 
-Holder& Holder::operator=(const Holder& h) {
-  if (this == &h) {
-    return *this;
-  }
-
-  for (int i = 0; i < NUM_TILES; i++) counts_[i] = h.counts_[i];
-
-  return *this;
-}
-
 // ============================================================================
 // Center class
 // ============================================================================
-Center::Center(Bag &bag) : bag_(bag) { Reset(); }
+template <int kPlayers>
+CenterT<kPlayers>::CenterT() { Clear(); }
+
+template <int kPlayers>
+CenterT<kPlayers>::CenterT(Bag &bag) {
+  uint64_t hash = 0;
+  Reset(bag, hash);
+}
 
-std::string Center::DebugStr() {
+template <int kPlayers>
+std::string CenterT<kPlayers>::DebugStr() {
   std::stringstream ss;
   for (int i = 0; i < NUM_POS; i++) {
     for (int j = 0; j < NUM_TILES; j++) {
@@ -121,7 +210,8 @@ std::string Center::DebugStr() {
   return ss.str();
 }
 
-void Center::CenterFromString(const std::string center) {
+template <int kPlayers>
+void CenterT<kPlayers>::CenterFromString(const std::string center) {
   CHECK(center.size() == NUM_FACTORIES * NUM_TILES_PER_FACTORY + NUM_CENTER);
   Clear();
   // fill the factories
@@ -145,30 +235,33 @@ void Center::CenterFromString(const std::string center) {
   }
 }
 
-void Center::Clear() {
-  for (int i = 0; i < NUM_FACTORIES + 1; i++) {
+template <int kPlayers>
+void CenterT<kPlayers>::Clear() {
+  for (int i = 0; i < NUM_POS; i++) {
     holders[i].Clear();
   }
   first = -1;
 }
 
-void Center::Reset() {
-  first = -1;
+template <int kPlayers>
+void CenterT<kPlayers>::Reset(Bag &bag, uint64_t &hash) {
+  hash ^= Hash();
+  Clear();
   for (int i = 0; i < NUM_FACTORIES; i++) {
-    holders[i].Clear();
-    for (int j = 0; j < NUM_TILES_PER_FACTORY; j++) {
-      Tile t = bag_.Pop();
-      holders[i].Add(t);
-    }
+    bag.Draw(NUM_TILES_PER_FACTORY, holders[i].counts_, hash);
   }
+  hash ^= Hash();
 }
 
-void Center::AddTile(Tile tile, Position pos, int num) {
+template <int kPlayers>
+void CenterT<kPlayers>::AddTile(Tile tile, Position pos, int num) {
   holders[pos].Add(tile, num);
 }
 
-int Center::TakeTiles(Position pos, Tile tile) {
+template <int kPlayers>
+int CenterT<kPlayers>::TakeTiles(Position pos, Tile tile, uint64_t &hash) {
   int num = holders[pos].Take(tile);
+  hash ^= zobrist::Holder(pos, tile, num);
   if (pos != CENTER) {
     for (int i = 0; i < NUM_TILES; i++) {
       if (i == tile) {
@@ -176,6 +269,9 @@ int Center::TakeTiles(Position pos, Tile tile) {
       }
       // move remaining tiles from the factory to the center
       int n = holders[pos].Take(Tile(i));
+      int c = holders[CENTER].Count(Tile(i));
+      hash ^= zobrist::Holder(pos, i, n) ^ zobrist::Holder(CENTER, i, c) ^
+              zobrist::Holder(CENTER, i, c + n);
       holders[CENTER].Add(Tile(i), n);
     }
   }
@@ -183,7 +279,15 @@ int Center::TakeTiles(Position pos, Tile tile) {
   return num;
 }
 
-bool Center::IsRoundOver() {
+template <int kPlayers>
+uint64_t CenterT<kPlayers>::Hash() const {
+  uint64_t hash = zobrist::First(first);
+  for (int i = 0; i < NUM_POS; i++) hash ^= holders[i].Hash(Position(i));
+  return hash;
+}
+
+template <int kPlayers>
+bool CenterT<kPlayers>::IsRoundOver() {
   for (int i = 0; i < NUM_POS; i++) {
     if (holders[i].Count() > 0) {
       return false;
@@ -192,27 +296,14 @@ bool Center::IsRoundOver() {
   return true;
 }
 
-int Center::Count(Position pos, Tile tile) { return holders[pos].Count(tile); }
-
-int Center::Count(Position pos) { return holders[pos].Count(); }
-
-void Center::NextRound() {
-  for (int i = 0; i < NUM_FACTORIES; i++) {
-    for (int j = 0; j < NUM_TILES_PER_FACTORY; j++) {
-      Tile t = bag_.Pop();
-      holders[i].Add(t);
-    }
-  }
-  first = -1;
+template <int kPlayers>
+int CenterT<kPlayers>::Count(Position pos, Tile tile) {
+  return holders[pos].Count(tile);
 }
 
-Center& Center::operator=(const Center& c) {
-  if (this == &c) {
-    return *this;
-  }
-
-  for (int i = 0; i < NUM_POS; i++) holders[i] = c.holders[i];
-  first = c.first;
+template <int kPlayers>
+int CenterT<kPlayers>::Count(Position pos) { return holders[pos].Count(); }
 
-  return *this;
-}
+template class CenterT<2>;
+template class CenterT<3>;
+template class CenterT<4>;
@@ -6,25 +6,48 @@
 
 #include "constants.h"
 
+template <int kPlayers>
+class StateT;
+
+namespace utils {
+class Xoshiro256;
+}
+
 class Bag {
  public:
+  friend class GameBatch;
+  template <int kPlayers>
+  friend class StateT;
   /* nof tiles in the bag initially */
-  static const int BAG_SIZE = 100;
+  static constexpr int BAG_SIZE = 100;
+  /* most tiles taken by a single Draw(), a factory */
+  static constexpr int MAX_DRAW = 4;
 
   Bag();
   // full bag reset, restores bag to full size (100)
   void Reset();
 
   // puts the returned tiles back into the bag
-  void ReShuffle();
+  void ReShuffle(uint64_t &hash);
 
-  // adds tiles to the return pile
+  // adds tiles to the return pile, negative num takes them back
   void Return(Tile tile, int num);
 
   // get a random tile from the bag
-  Tile Pop();
+  Tile Pop(uint64_t &hash);
+
+  // draws n tiles at once and adds them to counts, same distribution as n
+  // calls to Pop(), returns the nof tiles drawn
+  int Draw(int n, uint8_t *counts, uint64_t &hash);
+  // same with the random numbers taken from rng
+  int Draw(int n, uint8_t *counts, uint64_t &hash, utils::Xoshiro256 &rng);
+
+  // takes out the counts tiles of a series of Draw() calls, refilling from the
+  // return pile in between just like Draw() does
+  void Remove(const uint8_t *counts, uint64_t &hash);
 
-  Bag &operator=(const Bag &bag);
+  // zobrist hash of the tiles in the bag, the return pile is not part of it
+  uint64_t Hash() const;
 
   uint8_t tiles[NUM_TILES];
 
@@ -42,38 +65,47 @@ class Holder {
   int Count();
   int Count(Tile tile);
   void Clear();
-  Holder &operator=(const Holder &h);
+  // bit i is set if the holder contains tiles of type i
+  uint32_t Present() const;
+  uint64_t Hash(Position pos) const;
   uint8_t counts_[NUM_TILES];
 };
 
-class Center {
+// factories and the center of a game with kPlayers players
+template <int kPlayers>
+class CenterT {
  public:
-  /* nof factories in 1v1 gameplay */
-  static const int NUM_FACTORIES = 5;
+  /* nof factories: 5, 7 or 9 */
+  static constexpr int NUM_FACTORIES = GameSize<kPlayers>::kFactories;
+  /* factories + center, shadows the 2 player enum */
+  static constexpr int NUM_POS = GameSize<kPlayers>::kPositions;
+  static constexpr Position CENTER = Position(GameSize<kPlayers>::kCenter);
   /* tiles a single factory can hold maximum */
-  static const int NUM_TILES_PER_FACTORY = 4;
-  /* maximum center tiles: 4*5 - 5 */
-  static const int NUM_CENTER = (NUM_TILES_PER_FACTORY - 1) * NUM_FACTORIES;
+  static constexpr int NUM_TILES_PER_FACTORY = 4;
+  /* maximum center tiles: 3 per factory */
+  static constexpr int NUM_CENTER = (NUM_TILES_PER_FACTORY - 1) * NUM_FACTORIES;
 
-  /* first tile belongs to {-1, 0, 1} (none, player 0, player 1) */
+  /* first tile belongs to -1 (none) or a player */
   int8_t first{-1};
 
-  Center(Bag &bag);
+  // empty center, use Reset() to fill the factories
+  CenterT();
+  // draws the factories from the bag, the caller computes the hash afterwards
+  explicit CenterT(Bag &bag);
 
   std::string DebugStr();
   void CenterFromString(const std::string center);
-  void Reset();
-  void NextRound();
+  // fills the factories with tiles drawn from the bag
+  void Reset(Bag &bag, uint64_t &hash);
   bool IsRoundOver();
   void Clear();
   int Count(Position pos);
   int Count(Position pos, Tile tile);
   // assume we can always add tiles to the center legally
   void AddTile(Tile tile, Position pos, int num = 1);
-  int TakeTiles(Position pos, Tile tile);
-  Center &operator=(const Center &c);
+  int TakeTiles(Position pos, Tile tile, uint64_t &hash);
+  uint64_t Hash() const;
   Holder holders[NUM_POS];
-
- private:
-  Bag &bag_;
 };
+
+using Center = CenterT<2>;
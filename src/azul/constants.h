@@ -6,15 +6,44 @@
 /*                    0     1       2    3      4      5 */
 enum Tile : uint8_t { BLUE, YELLOW, RED, BLACK, WHITE, NUM_TILES };
 
-/* part of an action or move */
+/* part of an action or move, positions of the 2 player game. With more
+ * players the factories continue up to GameSize::kCenter */
 enum Position : uint8_t { FAC1, FAC2, FAC3, FAC4, FAC5, CENTER, NUM_POS };
 
 /* part of an action or move */
 enum Line : uint8_t { LINE1, LINE2, LINE3, LINE4, LINE5, FLOORLINE, NUM_LINES };
 
+/* supported player counts */
+static constexpr int kMinPlayers = 2;
+static constexpr int kMaxPlayers = 4;
+
+// Sizes of a game with kPlayers players, all known at compile time such that
+// the game core needs no runtime sized containers.
+template <int kPlayers>
+struct GameSize {
+  static_assert(kPlayers >= kMinPlayers && kPlayers <= kMaxPlayers,
+                "Azul is played with 2, 3 or 4 players");
+
+  /* factories: 5, 7 or 9 */
+  static constexpr int kFactories = 2 * kPlayers + 1;
+  /* factories + center */
+  static constexpr int kPositions = kFactories + 1;
+  static constexpr int kCenter = kFactories;
+  /* maximum number of moves */
+  static constexpr int kMoves = kPositions * NUM_TILES * NUM_LINES;
+  /* input planes, see kNumPlanes for the layout of 2 players */
+  static constexpr int kPlanes = 18 * kPlayers + 13;
+};
+
+/* maximum number of positions of any player count */
+static constexpr int kMaxPositions = GameSize<kMaxPlayers>::kPositions;
+
 /* maximum number of moves */
-static const int kNumMoves = NUM_POS * NUM_TILES * NUM_LINES;
+static const int kNumMoves = GameSize<2>::kMoves;
 
+// With n players and f = 2n + 1 factories: n scores, 5 bag, 4f factories,
+// 3f center, 1st tile and 3n boards (us first, then in turn order).
+//
 // 1 + 1 + 5 + 5*4 + 15 + 1 + 1 + 1 + 1 + 1 + 1 + 1 = 49
 // |   |   |   |     |    |   |   |   |   |   |   |
 // |   |   |   |     |    |   |   |   |   |   |   them floor: v in {0,...,7}
@@ -29,4 +58,5 @@ static const int kNumMoves = NUM_POS * NUM_TILES * NUM_LINES;
 // |   |   bag: v in {0,...,20}
 // |   them score: v in {0,...,255}
 // us score: v in {0,...,255}
-static const int kNumPlanes = 49;
+static const int kNumPlanes = GameSize<2>::kPlanes;
+static_assert(kNumPlanes == 49, "2 player plane layout changed");
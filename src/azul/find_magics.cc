@@ -1,11 +1,21 @@
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "magics.h"
 #include "board.h"
 
+// usage: find_magics <bits> to generate magics, find_magics check to validate
+// the score tables against a direct computation
 int main(int argc, char **argv) {
   if (argc != 2) return 1;
+
+  if (strcmp(argv[1], "check") == 0) {
+    int errors = CheckScoreTables();
+    printf("%d errors in the score tables\n", errors);
+    return errors != 0;
+  }
+
   int bits = std::atoi(argv[1]);
 
   printf("static const uint32_t kMagics[] = {\n");
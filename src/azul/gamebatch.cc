@@ -0,0 +1,484 @@
+#include "gamebatch.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+
+#include "planes.h"
+
+// every placement, including the floorline
+static constexpr uint32_t kAllLines =
+    Board::LineBits(LINE1) | Board::LineBits(LINE2) | Board::LineBits(LINE3) |
+    Board::LineBits(LINE4) | Board::LineBits(LINE5) |
+    Board::LineBits(FLOORLINE);
+
+// bits set in x, without the popcnt instruction that lane loops can't use
+static inline uint32_t CountBits(uint32_t x) {
+  x = x - ((x >> 1) & 0x55555555u);
+  x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+  x = (x + (x >> 4)) & 0x0f0f0f0fu;
+  return (x * 0x01010101u) >> 24;
+}
+
+// GetScore() of the tile at square on wall, computed without tables such that
+// lane loops vectorize. The runs through square along its row and column grow
+// by a tile per step.
+static inline uint32_t RunScore(uint32_t wall, uint32_t square, uint32_t row) {
+  uint32_t h = square, v = square;
+  for (int i = 1; i < Board::SIZE; i++) {
+    h |= ((h << 1) | (h >> 1)) & wall & row;
+    v |= ((v << Board::SIZE) | (v >> Board::SIZE)) & wall;
+  }
+  const uint32_t nh = CountBits(h), nv = CountBits(v);
+  const uint32_t score = (nh > 1 ? nh : 0) + (nv > 1 ? nv : 0);
+  return score ? score : 1;
+}
+
+// Board::kAllTiles of a tile without the table, the diagonal of BLUE moved
+// right by tile columns. Squares pushed past the end of their row wrap
+// around to its start.
+static constexpr uint32_t AllTiles(uint32_t tile) {
+  const uint32_t kept = (1u << (Board::SIZE * (Board::SIZE - tile))) - 1;
+  const uint32_t diagonal = Board::kAllTiles[BLUE];
+  return (diagonal & kept) << tile |
+         ((diagonal & ~kept) << tile) >> Board::SIZE;
+}
+
+// Board::kPenalty of a floorline without the table
+static constexpr int Penalty(int floorline) {
+  const int n = std::min(floorline, Board::kFloorLineSize);
+  return n + std::max(0, n - 2) + std::max(0, n - 5);
+}
+
+static constexpr bool AllTilesMatch() {
+  for (int tile = 0; tile < NUM_TILES; tile++) {
+    if (AllTiles(tile) != Board::kAllTiles[tile]) return false;
+  }
+  return true;
+}
+static_assert(AllTilesMatch(), "AllTiles() differs from Board::kAllTiles");
+
+static constexpr bool PenaltiesMatch() {
+  for (int n = 0; n <= Board::kFloorLineSize + 1; n++) {
+    if (Penalty(n) != Board::kPenalty[std::min(n, Board::kFloorLineSize)]) {
+      return false;
+    }
+  }
+  return true;
+}
+static_assert(PenaltiesMatch(), "Penalty() differs from Board::kPenalty");
+
+GameBatch::GameBatch(int size) : size_(size) {
+  CHECK(size > 0) << "Invalid batch size " << size;
+
+  for (int p = 0; p < 2; p++) {
+    wall_[p].resize(size);
+    for (int i = 0; i < Board::SIZE; i++) {
+      type_[p][i].resize(size);
+      count_[p][i].resize(size);
+    }
+    floorline_[p].resize(size);
+    score_[p].resize(size);
+    terminal_[p].resize(size);
+  }
+
+  for (int t = 0; t < NUM_TILES; t++) {
+    for (int pos = 0; pos < NUM_POS; pos++) holders_[pos][t].resize(size);
+    bag_[t].resize(size);
+    returned_[t].resize(size);
+  }
+  bag_size_.resize(size);
+  first_.resize(size);
+  turn_.resize(size);
+  prev_turn_.resize(size);
+  lines_.resize(size);
+  round_over_.resize(size);
+  pos_.resize(size);
+  tile_.resize(size);
+  line_.resize(size);
+  num_.resize(size);
+  leftover_.resize(size);
+
+  Reset();
+}
+
+void GameBatch::Set(int lane, const State &state) {
+  for (int p = 0; p < 2; p++) {
+    const Board &b = state.boards_[p];
+    wall_[p][lane] = b.wall;
+    for (int i = 0; i < Board::SIZE; i++) {
+      type_[p][i][lane] = b.left[i].tile_type;
+      count_[p][i][lane] = b.left[i].count;
+    }
+    floorline_[p][lane] = b.floorline;
+    score_[p][lane] = b.score_;
+    terminal_[p][lane] = b.terminal_;
+  }
+
+  for (int t = 0; t < NUM_TILES; t++) {
+    for (int pos = 0; pos < NUM_POS; pos++) {
+      holders_[pos][t][lane] = state.center_.holders[pos].counts_[t];
+    }
+    bag_[t][lane] = state.bag_.tiles[t];
+    returned_[t][lane] = state.bag_.returned_[t];
+  }
+  bag_size_[lane] = state.bag_.size_;
+  first_[lane] = state.center_.first;
+  turn_[lane] = state.turn_;
+  prev_turn_[lane] = state.prev_turn_;
+}
+
+State GameBatch::Get(int lane) const {
+  State state;
+
+  for (int p = 0; p < 2; p++) {
+    Board &b = state.boards_[p];
+    b.wall = wall_[p][lane];
+    for (int i = 0; i < Board::SIZE; i++) {
+      b.left[i].tile_type = type_[p][i][lane];
+      b.left[i].count = count_[p][i][lane];
+    }
+    b.floorline = floorline_[p][lane];
+    b.score_ = score_[p][lane];
+    b.terminal_ = terminal_[p][lane];
+  }
+
+  for (int t = 0; t < NUM_TILES; t++) {
+    for (int pos = 0; pos < NUM_POS; pos++) {
+      state.center_.holders[pos].counts_[t] = holders_[pos][t][lane];
+    }
+    state.bag_.tiles[t] = bag_[t][lane];
+    state.bag_.returned_[t] = returned_[t][lane];
+  }
+  state.bag_.size_ = bag_size_[lane];
+  state.center_.first = first_[lane];
+  state.turn_ = turn_[lane];
+  state.prev_turn_ = prev_turn_[lane];
+  state.hash_ = state.ComputeHash();
+
+  return state;
+}
+
+void GameBatch::Reset() {
+  const int n = size_;
+  for (int p = 0; p < 2; p++) {
+    std::fill(wall_[p].begin(), wall_[p].end(), 0);
+    for (int i = 0; i < Board::SIZE; i++) {
+      std::fill(type_[p][i].begin(), type_[p][i].end(), 0);
+      std::fill(count_[p][i].begin(), count_[p][i].end(), 0);
+    }
+    std::fill(floorline_[p].begin(), floorline_[p].end(), 0);
+    std::fill(score_[p].begin(), score_[p].end(), 0);
+    std::fill(terminal_[p].begin(), terminal_[p].end(), 0);
+  }
+
+  for (int t = 0; t < NUM_TILES; t++) {
+    for (int pos = 0; pos < NUM_POS; pos++) {
+      std::fill(holders_[pos][t].begin(), holders_[pos][t].end(), 0);
+    }
+    std::fill(bag_[t].begin(), bag_[t].end(), Bag::BAG_SIZE / NUM_TILES);
+    std::fill(returned_[t].begin(), returned_[t].end(), 0);
+  }
+  std::fill(bag_size_.begin(), bag_size_.end(), Bag::BAG_SIZE);
+  std::fill(first_.begin(), first_.end(), -1);
+  std::fill(turn_.begin(), turn_.end(), 0);
+  std::fill(prev_turn_.begin(), prev_turn_.end(), 0);
+
+  for (int l = 0; l < n; l++) Refill(l);
+}
+
+bool GameBatch::IsTerminal(int lane) const {
+  return terminal_[0][lane] || terminal_[1][lane];
+}
+
+void GameBatch::LegalMasks(MoveMask *masks) const {
+  const int n = size_;
+  uint32_t *lines = lines_.data();
+  const uint8_t *turn = turn_.data();
+
+  // legal (tile, line) placements of the player to move, see
+  // Board::LegalLines()
+  for (int l = 0; l < n; l++) lines[l] = kAllLines;
+
+  for (int i = 0; i < Board::SIZE; i++) {
+    const uint8_t *type0 = type_[0][i].data(), *type1 = type_[1][i].data();
+    const uint8_t *count0 = count_[0][i].data(), *count1 = count_[1][i].data();
+    const uint32_t *wall0 = wall_[0].data(), *wall1 = wall_[1].data();
+
+    for (int l = 0; l < n; l++) {
+      const uint32_t type = turn[l] ? type1[l] : type0[l];
+      const uint32_t count = turn[l] ? count1[l] : count0[l];
+      const uint32_t wall = turn[l] ? wall1[l] : wall0[l];
+
+      uint32_t blocked = 0;
+      for (int tile = 0; tile < NUM_TILES; tile++) {
+        const int square = i * Board::SIZE + Board::Column(i, tile);
+        blocked |= ((wall >> square) & 1u) << Board::LineBit(tile, i);
+      }
+      const uint32_t keep = count == 0 ? 0u : 1u << Board::LineBit(type, i);
+      blocked |= count == uint32_t(i + 1) ? Board::LineBits(i) : 0u;
+      blocked |= count > 0 ? Board::LineBits(i) & ~keep : 0u;
+      lines[l] &= ~blocked;
+    }
+  }
+
+  // combine with the tiles present in every holder
+  for (int w = 0; w < MoveMask::kNumWords; w++) {
+    for (int l = 0; l < n; l++) {
+      uint64_t lo = 0, hi = 0;
+      for (int tile = 0; tile < NUM_TILES; tile++) {
+        const uint64_t group = 0x3full << (tile * NUM_LINES);
+        lo |= holders_[2 * w][tile][l] ? group : 0ull;
+        hi |= holders_[2 * w + 1][tile][l] ? group : 0ull;
+      }
+      masks[l].bits[w] = (lo | hi << MoveMask::kMovesPerPos) &
+                         (lines[l] | uint64_t(lines[l])
+                                         << MoveMask::kMovesPerPos);
+    }
+  }
+}
+
+void GameBatch::Step(const uint8_t *moves) {
+  const int n = size_;
+  uint8_t *pos = pos_.data(), *tile = tile_.data(), *line = line_.data();
+  uint8_t *num = num_.data();
+  // see Move::Id()
+  for (int l = 0; l < n; l++) {
+    pos[l] = moves[l] / MoveMask::kMovesPerPos;
+    tile[l] = moves[l] / NUM_LINES % NUM_TILES;
+    line[l] = moves[l] % NUM_LINES;
+    num[l] = 0;
+  }
+
+  // take the tiles, see State::Step()
+  for (int p = 0; p < NUM_POS; p++) {
+    for (int t = 0; t < NUM_TILES; t++) {
+      uint8_t *h = holders_[p][t].data();
+      for (int l = 0; l < n; l++) {
+        const bool take = pos[l] == p && tile[l] == t;
+        num[l] += take ? h[l] : 0;
+        h[l] = take ? 0 : h[l];
+      }
+    }
+  }
+  // the rest of a factory goes to the center
+  for (int p = 0; p < CENTER; p++) {
+    for (int t = 0; t < NUM_TILES; t++) {
+      uint8_t *h = holders_[p][t].data(), *center = holders_[CENTER][t].data();
+      for (int l = 0; l < n; l++) {
+        const bool taken = pos[l] == p;
+        center[l] += taken ? h[l] : 0;
+        h[l] = taken ? 0 : h[l];
+      }
+    }
+  }
+
+  // the tiles go on the pattern line, the overflow to the floorline, see
+  // Board::ApplyMove()
+  const uint8_t *turn = turn_.data();
+  for (int p = 0; p < 2; p++) {
+    for (int i = 0; i < Board::SIZE; i++) {
+      uint8_t *type = type_[p][i].data(), *count = count_[p][i].data();
+      for (int l = 0; l < n; l++) {
+        type[l] = turn[l] == p && line[l] == i ? tile[l] : type[l];
+      }
+      for (int l = 0; l < n; l++) {
+        const bool placed = turn[l] == p && line[l] == i;
+        const uint8_t sum = count[l] + num[l];
+        const uint8_t kept = std::min(sum, uint8_t(i + 1));
+        count[l] = placed ? kept : count[l];
+        num[l] = placed ? uint8_t(sum - kept) : num[l];
+      }
+    }
+  }
+  for (int t = 0; t < NUM_TILES; t++) {
+    uint8_t *returned = returned_[t].data();
+    for (int l = 0; l < n; l++) returned[l] += tile[l] == t ? num[l] : 0;
+  }
+  // whoever takes from the center first also takes the first tile
+  int8_t *first = first_.data();
+  for (int l = 0; l < n; l++) {
+    const bool take = first[l] == -1 && pos[l] == CENTER;
+    first[l] = take ? turn[l] : first[l];
+    num[l] += take;
+  }
+  for (int p = 0; p < 2; p++) {
+    uint8_t *floorline = floorline_[p].data();
+    for (int l = 0; l < n; l++) floorline[l] += turn[l] == p ? num[l] : 0;
+  }
+
+  // the round is over when all holders are empty
+  uint8_t *over = round_over_.data();
+  std::fill(round_over_.begin(), round_over_.end(), 0);
+  for (int p = 0; p < NUM_POS; p++) {
+    for (int t = 0; t < NUM_TILES; t++) {
+      const uint8_t *h = holders_[p][t].data();
+      for (int l = 0; l < n; l++) over[l] |= h[l];
+    }
+  }
+  for (int l = 0; l < n; l++) over[l] = over[l] == 0;
+
+  // the first player of a round is whoever took the first tile
+  uint8_t *next = turn_.data();
+  std::copy(turn_.begin(), turn_.end(), prev_turn_.begin());
+  for (int l = 0; l < n; l++) {
+    const uint8_t starts = first[l] == 1 ? 1 : 0;
+    next[l] = over[l] ? starts : next[l] ^ 1u;
+  }
+
+  NextRound();
+}
+
+void GameBatch::NextRound() {
+  const int n = size_;
+  const uint8_t *over = round_over_.data();
+
+  for (int p = 0; p < 2; p++) {
+    uint32_t *wall = wall_[p].data();
+    int16_t *score = score_[p].data();
+    uint8_t *terminal = terminal_[p].data();
+    uint8_t *floorline = floorline_[p].data();
+
+    // 1. move full lines to the wall and score them, see Board::NextRound()
+    for (int i = 0; i < Board::SIZE; i++) {
+      const uint8_t *type = type_[p][i].data();
+      uint8_t *count = count_[p][i].data();
+      uint8_t *leftover = leftover_.data();
+
+      for (int l = 0; l < n; l++) {
+        const bool full = over[l] & (count[l] == i + 1);
+        const uint32_t col = Board::Column(i, type[l]);
+        const uint32_t square = 1u << (i * Board::SIZE + col);
+        const uint32_t w = wall[l] | square;
+        const uint32_t all_tiles = AllTiles(type[l]);
+        const uint32_t column = Board::kColumns[0] << col;
+        const bool row = (w & Board::kRows[i]) == Board::kRows[i];
+
+        const int gain = RunScore(w, square, Board::kRows[i]) +
+                         (row ? Board::kBonusRow : 0) +
+                         ((w & column) == column ? Board::kBonusCol : 0) +
+                         ((w & all_tiles) == all_tiles ? Board::kBonusTiles
+                                                       : 0);
+        score[l] += full ? gain : 0;
+        wall[l] = full ? w : wall[l];
+      }
+      // byte lanes apart from the wall, fewer arrays per loop keep the
+      // compiler's overlap checks within bounds
+      for (int l = 0; l < n; l++) {
+        const bool full = over[l] & (count[l] == i + 1);
+        leftover[l] = full ? count[l] - 1 : 0;
+        count[l] = full ? 0 : count[l];
+      }
+      for (int t = 0; t < NUM_TILES; t++) {
+        uint8_t *bag = returned_[t].data();
+        for (int l = 0; l < n; l++) bag[l] += type[l] == t ? leftover[l] : 0;
+      }
+    }
+
+    // a full wall row ends the game
+    for (int l = 0; l < n; l++) {
+      bool row = false;
+      for (int i = 0; i < Board::SIZE; i++) {
+        row |= (wall[l] & Board::kRows[i]) == Board::kRows[i];
+      }
+      terminal[l] |= row;
+    }
+
+    // 2. floorline penalties
+    for (int l = 0; l < n; l++) {
+      const int penalty = over[l] ? Penalty(floorline[l]) : 0;
+      score[l] = std::max(0, score[l] - penalty);
+      floorline[l] = over[l] ? 0 : floorline[l];
+    }
+  }
+
+  // 3. refill the factories, the draws of a bag depend on each other
+  for (int l = 0; l < n; l++) {
+    if (over[l]) Refill(l);
+  }
+}
+
+void GameBatch::Refill(int l) {
+  // gather the bag of the lane, see Center::NextRound()
+  Bag bag;
+  for (int t = 0; t < NUM_TILES; t++) {
+    bag.tiles[t] = bag_[t][l];
+    bag.returned_[t] = returned_[t][l];
+  }
+  bag.size_ = bag_size_[l];
+
+  uint64_t hash = 0;
+  for (int i = 0; i < Center::NUM_FACTORIES; i++) {
+    uint8_t counts[NUM_TILES] = {};
+    bag.Draw(Center::NUM_TILES_PER_FACTORY, counts, hash);
+    for (int t = 0; t < NUM_TILES; t++) holders_[i][t][l] += counts[t];
+  }
+
+  for (int t = 0; t < NUM_TILES; t++) {
+    bag_[t][l] = bag.tiles[t];
+    returned_[t][l] = bag.returned_[t];
+  }
+  bag_size_[l] = bag.size_;
+  first_[l] = -1;
+}
+
+void GameBatch::MakePlanes(float *planes) const {
+  const int n = size_;
+  for (int l = 0; l < n; l++) {
+    EncodePlanes(l, &planes[l * kNumPlanes * kPlaneSize]);
+  }
+}
+
+void GameBatch::EncodePlanes(int l, float *planes) const {
+  // NOTE: Order matters! Should be equal to State::EncodePlanes()
+  const int me = turn_[l], op = 1 ^ me;
+  float *plane = planes;
+
+  // scores
+  FillPlane(plane, uint8_t(score_[me][l]) / 255.0f);
+  plane += kPlaneSize;
+  FillPlane(plane, uint8_t(score_[op][l]) / 255.0f);
+  plane += kPlaneSize;
+
+  // bag
+  for (int t = 0; t < NUM_TILES; t++) {
+    FillPlane(plane, bag_[t][l] / 20.0f);
+    plane += kPlaneSize;
+  }
+
+  // factories + center
+  for (int f = 0; f < NUM_POS; f++) {
+    int empty = (f == CENTER ? Center::NUM_CENTER
+                             : Center::NUM_TILES_PER_FACTORY);
+    for (int t = 0; t < NUM_TILES; t++) {
+      for (int j = 0; j < holders_[f][t][l]; j++) {
+        FillPlane(plane, (t + 1) / 5.0f);
+        plane += kPlaneSize;
+        empty--;
+      }
+    }
+    for (int e = 0; e < empty; e++) {
+      FillPlane(plane, 0.0f);
+      plane += kPlaneSize;
+    }
+  }
+
+  // first tile
+  FillPlane(plane, (first_[l] + 1) / 2.0f);
+  plane += kPlaneSize;
+
+  // left, wall and floor of me and op
+  for (int p : {me, op}) {
+    FillPlane(plane, 0.0f);
+    for (int i = 0; i < Board::SIZE; i++) {
+      RowPlane(plane, i, type_[p][i][l], count_[p][i][l]);
+    }
+    plane += kPlaneSize;
+    WallPlane(plane, wall_[p][l]);
+    plane += kPlaneSize;
+    FillPlane(plane, floorline_[p][l] / 7.0f);
+    plane += kPlaneSize;
+  }
+
+  DCHECK(plane == planes + kNumPlanes * kPlaneSize);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "board.h"
+#include "constants.h"
+#include "move.h"
+#include "state.h"
+
+// Many games stored as a structure of arrays, every operation runs over all
+// lanes at once. Lane loops are free of data dependent control flow and table
+// lookups such that the compiler vectorizes them. Two parts stay per lane:
+// refills, as every tile drawn from a bag changes the odds of the next one,
+// and MakePlanes(), whose NCHW output keeps the planes of a lane together
+// and is written a plane at a time. Results are identical to stepping every
+// lane with its own State.
+class GameBatch {
+ public:
+  explicit GameBatch(int size);
+
+  int Size() const { return size_; }
+  // copies a state into a lane and back
+  void Set(int lane, const State &state);
+  State Get(int lane) const;
+  // starts a new game in every lane
+  void Reset();
+  bool IsTerminal(int lane) const;
+
+  // legal moves of every lane
+  void LegalMasks(MoveMask *masks) const;
+  // applies moves[lane] to every lane, lanes that end their round are scored
+  // and refilled from their bag
+  void Step(const uint8_t *moves);
+  // encodes all lanes into a single NCHW batch, see State::MakePlanes()
+  void MakePlanes(float *planes) const;
+
+ private:
+  template <typename T>
+  using Lanes = std::vector<T>;
+
+  int size_;
+
+  // boards
+  Lanes<uint32_t> wall_[2];
+  Lanes<uint8_t> type_[2][Board::SIZE];
+  Lanes<uint8_t> count_[2][Board::SIZE];
+  Lanes<uint8_t> floorline_[2];
+  Lanes<int16_t> score_[2];
+  Lanes<uint8_t> terminal_[2];
+
+  // center and bag
+  Lanes<uint8_t> holders_[NUM_POS][NUM_TILES];
+  Lanes<uint8_t> bag_[NUM_TILES];
+  Lanes<uint8_t> returned_[NUM_TILES];
+  Lanes<uint8_t> bag_size_;
+  Lanes<int8_t> first_;
+
+  Lanes<uint8_t> turn_;
+  Lanes<uint8_t> prev_turn_;
+
+  // scratch space
+  mutable Lanes<uint32_t> lines_;
+  Lanes<uint8_t> round_over_;
+  // the move of every lane and the tiles it takes
+  Lanes<uint8_t> pos_;
+  Lanes<uint8_t> tile_;
+  Lanes<uint8_t> line_;
+  Lanes<uint8_t> num_;
+  // tiles of a full pattern line that go back to the bag
+  Lanes<uint8_t> leftover_;
+
+  void NextRound();
+  void Refill(int lane);
+  void EncodePlanes(int lane, float *planes) const;
+};
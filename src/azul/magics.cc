@@ -1,108 +1,42 @@
 #include "magics.h"
 
 #include <glog/logging.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #include <utils/random.h>
 
+#include <atomic>
 #include <vector>
 
 #include "board.h"
 
 // nof bits used per square entry
-static const int kMagicBits = 8;
+static constexpr int kMagicBits = 8;
+static constexpr int kSquares = Board::SIZE * Board::SIZE;
 
 // magics for 8 bit table, found using find_magics.cc
-static const uint32_t kMagics[] = {
+static constexpr uint32_t kMagics[] = {
     0x401041aul,  0x7c23192ul,  0x8044180ul,  0x18032080ul, 0x8091009ul,
     0x14200419ul, 0x20100120ul, 0x2fc02180ul, 0x9008088ul,  0x803149ul,
     0x1210022ul,  0x20258020ul, 0x8020110ul,  0x38060048ul, 0x6440041ul,
     0x940d8801ul, 0xe0048c01ul, 0x90082020ul, 0x18019008ul, 0x4622011ul,
     0x4c0a0480ul, 0x58244480ul, 0x9804c080ul, 0x28096280ul, 0x8010480ul};
 
-// score table for all squares
-static std::vector<uint8_t> scores_;
-
-
-// computes the horizontal and vertical mask given the current square
-static uint32_t ScoreMask(int square);
-// computes the score from the current board
-static int ComputeScore(int square, uint32_t board);
-// creates a board from an index
-static uint32_t IndexToBoard(int index, int bits, uint32_t mask);
-// converts a board into an index
-static int Transform(uint32_t board, uint32_t magic, int bits);
-// pops the lsb from a board and returns its position
-static int Pop1stBit(uint32_t* board);
-
-
 
 //=============================================================================
-// public functions
+// private functions
 //=============================================================================
-void InitScoreTable() {
-  uint32_t mask, board;
-  int square, i, index, n;
-
-  scores_.resize(Board::SIZE * Board::SIZE * (1 << kMagicBits));
-
-  for (square = 0; square < Board::SIZE * Board::SIZE; square++) {
-    mask = ScoreMask(square);
-    n = __builtin_popcount(mask);
-
-    for (i = 0; i < (1 << n); i++) {
-      board = IndexToBoard(i, n, mask);
-      index = square * (1 << kMagicBits);
-      index += Transform(board, kMagics[square], kMagicBits);
-      scores_[index] = ComputeScore(square, board);
-    }
-  }
-
-  VLOG(1) << "Initialized score table " << scores_.size() << " bytes";
-}
-
-
-int GetScore(int square, uint32_t board) {
-  board = ~board & ScoreMask(square);
-  int index = square * (1 << kMagicBits);
-  index += Transform(board, kMagics[square], kMagicBits);
-  return scores_[index];
-}
-
-
-uint32_t FindMagic(int square, int bits) {
-  static constexpr int kBits = 8;
-  static constexpr int N = 1 << kBits;
-
-  std::vector<uint8_t> used(1 << bits);
-  uint32_t mask = ScoreMask(square);
-  uint32_t block[N], magic;
-  uint8_t score[N];
-  int i, j, fail = 0;
-
-  for (i = 0; i < N; i++) {
-    block[i] = IndexToBoard(i, kBits, mask);
-    score[i] = ComputeScore(square, block[i]);
-  }
-
-  for (uint64_t k = 0; k < 1ull << 40ull; k++) {
-    magic = utils::Random::Get().GetFewBits32();
-    std::fill(begin(used), end(used), 0);
-    for (i = 0, fail = 0; !fail && i < N; i++) {
-      j = Transform(block[i], magic, bits);
-      if (used[j] == 0) used[j] = score[i];
-      else if (used[j] != score[i]) fail = 1;
-    }
-    if (!fail) return magic;
-  }
-
-  return 0ul;
+// pops the lsb from a board and returns its position
+static constexpr int Pop1stBit(uint32_t *board) {
+  int index = __builtin_ctz(*board);
+  *board &= (*board - 1);
+  return index;
 }
 
 
-
-//=============================================================================
-// private functions
-//=============================================================================
-uint32_t ScoreMask(int square) {
+// computes the horizontal and vertical mask given the current square
+static constexpr uint32_t ScoreMask(int square) {
   int row = square / Board::SIZE, col = square % Board::SIZE;
   uint32_t result = Board::kRows[row] | Board::kColumns[col];
   result ^= 1 << square;
@@ -110,8 +44,9 @@ uint32_t ScoreMask(int square) {
 }
 
 
-uint32_t IndexToBoard(int index, int bits, uint32_t mask) {
-  int i, j;
+// creates a board from an index
+static constexpr uint32_t IndexToBoard(int index, int bits, uint32_t mask) {
+  int i = 0, j = 0;
   uint32_t result = 0ul;
   for (i = 0; i < bits; i++) {
     j = Pop1stBit(&mask);
@@ -121,9 +56,10 @@ uint32_t IndexToBoard(int index, int bits, uint32_t mask) {
 }
 
 
-int ComputeScore(int square, uint32_t board) {
+// computes the score from the current board
+static constexpr int ComputeScore(int square, uint32_t board) {
   int hor = 0, ver = 0;
-  int row = square / Board::SIZE, col = square % Board::SIZE, i;
+  int row = square / Board::SIZE, col = square % Board::SIZE, i = 0;
 
   // horizontal
   for (i = col + 1; i <= 4; i++) {
@@ -157,15 +93,146 @@ int ComputeScore(int square, uint32_t board) {
 }
 
 
-int Transform(uint32_t board, uint32_t magic, int bits) {
+// converts a board into an index
+static constexpr int Transform(uint32_t board, uint32_t magic, int bits) {
   board *= magic;
   board >>= 32 - bits;
   return static_cast<int>(board);
 }
 
 
-int Pop1stBit(uint32_t *board) {
-  int index = __builtin_ffs(*board);
-  *board &= (*board - 1);
-  return index - 1;
+
+//=============================================================================
+// score tables, generated at compile time
+//=============================================================================
+// score tables for all squares, indexed by magic or by the pext of the empty
+// squares in the score mask
+struct ScoreTables {
+  uint32_t mask[kSquares];
+  uint8_t magic[kSquares][1 << kMagicBits];
+  uint8_t pext[kSquares][1 << kMagicBits];
+
+  constexpr ScoreTables() : mask{}, magic{}, pext{} {
+    for (int square = 0; square < kSquares; square++) {
+      mask[square] = ScoreMask(square);
+      int n = __builtin_popcount(mask[square]);
+
+      for (int i = 0; i < (1 << n); i++) {
+        uint32_t board = IndexToBoard(i, n, mask[square]);
+        int index = Transform(board, kMagics[square], kMagicBits);
+        magic[square][index] = ComputeScore(square, board);
+        pext[square][i] = ComputeScore(square, board);
+      }
+    }
+  }
+};
+
+static constexpr ScoreTables kScores;
+
+static bool CpuHasBmi2() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("bmi2");
+#else
+  return false;
+#endif
+}
+
+// pext is microcoded and a lot slower than the magic multiply on Zen1/Zen2
+// and no faster elsewhere, so it is only taken on request. Search threads
+// read it on every score, relaxed loads cost no more than a plain one.
+static std::atomic<ScorePath> score_path_{ScorePath::kMagic};
+
+
+
+//=============================================================================
+// public functions
+//=============================================================================
+int GetScore(int square, uint32_t board) {
+  if (score_path_.load(std::memory_order_relaxed) == ScorePath::kPext) {
+    return GetScorePext(square, board);
+  }
+  return GetScoreMagic(square, board);
+}
+
+
+int GetScoreMagic(int square, uint32_t board) {
+  board = ~board & kScores.mask[square];
+  return kScores.magic[square][Transform(board, kMagics[square], kMagicBits)];
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("bmi2"))) int GetScorePext(int square, uint32_t board) {
+  return kScores.pext[square][_pext_u32(~board, kScores.mask[square])];
+}
+#else
+int GetScorePext(int square, uint32_t board) {
+  // no pext instruction, the empty squares of the mask are gathered one by one
+  uint32_t mask = kScores.mask[square];
+  int index = 0;
+  for (int i = 0; mask; i++) {
+    if (~board & (1u << Pop1stBit(&mask))) index |= 1 << i;
+  }
+  return kScores.pext[square][index];
+}
+#endif
+
+
+ScorePath GetScorePath() {
+  return score_path_.load(std::memory_order_relaxed);
+}
+
+
+bool SetScorePath(ScorePath path) {
+  if (path == ScorePath::kPext && !CpuHasBmi2()) return false;
+  score_path_.store(path, std::memory_order_relaxed);
+  return true;
+}
+
+
+int CheckScoreTables() {
+  int errors = 0;
+  for (int square = 0; square < kSquares; square++) {
+    int n = __builtin_popcount(kScores.mask[square]);
+    for (int i = 0; i < (1 << n); i++) {
+      // every square outside of the mask is filled
+      uint32_t board = IndexToBoard(i, n, kScores.mask[square]);
+      uint32_t wall = ~board & ((1u << kSquares) - 1);
+      int score = ComputeScore(square, board);
+      errors += GetScoreMagic(square, wall) != score;
+      if (CpuHasBmi2()) errors += GetScorePext(square, wall) != score;
+    }
+  }
+  return errors;
+}
+
+
+uint32_t FindMagic(int square, int bits) {
+  static constexpr int kBits = 8;
+  static constexpr int N = 1 << kBits;
+
+  std::vector<uint8_t> used(1 << bits);
+  uint32_t mask = ScoreMask(square);
+  uint32_t block[N], magic;
+  uint8_t score[N];
+  int i, j, fail = 0;
+
+  for (i = 0; i < N; i++) {
+    block[i] = IndexToBoard(i, kBits, mask);
+    score[i] = ComputeScore(square, block[i]);
+  }
+
+  for (uint64_t k = 0; k < 1ull << 40ull; k++) {
+    magic = utils::Random::Get().GetFewBits32();
+    std::fill(begin(used), end(used), 0);
+    for (i = 0, fail = 0; !fail && i < N; i++) {
+      j = Transform(block[i], magic, bits);
+      if (used[j] == 0) used[j] = score[i];
+      else if (used[j] != score[i]) fail = 1;
+    }
+    if (!fail) return magic;
+  }
+
+  return 0ul;
 }
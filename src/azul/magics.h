@@ -7,11 +7,24 @@
 // public functions
 //=============================================================================
 
-// score lookup using magics, call InitScoreTable() first
+// score of a tile placed on square of the wall board, the tables are
+// generated at compile time so no initialization is needed
 int GetScore(int square, uint32_t board);
 
-// initializes the score lookup table, must be done before calling GetScore()
-void InitScoreTable();
+// implementations behind GetScore(), pext needs a cpu with bmi2
+int GetScoreMagic(int square, uint32_t board);
+int GetScorePext(int square, uint32_t board);
+
+enum class ScorePath { kMagic, kPext };
+
+// GetScore() uses magics unless pext is selected with SetScorePath()
+ScorePath GetScorePath();
+// overrides the implementation, returns false if the cpu can't run it. Safe
+// while other threads score, they switch over at some later GetScore()
+bool SetScorePath(ScorePath path);
+
+// compares both tables against a direct computation, returns nof errors
+int CheckScoreTables();
 
 // tries to find a magic through random guessing
 uint32_t FindMagic(int square, int bits);
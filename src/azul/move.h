@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <array>
 #include <unordered_map>
 
 #include "constants.h"
@@ -8,9 +9,15 @@
 class Move {
  public:
   Move() : factory(FAC1), line(LINE1), tile_type(BLUE) {}
-  Move(uint8_t id);
+  Move(int id);
   Move(Position factory, Tile tile, Line line);
 
+  // compact move id in [0, GameSize::kMoves), equal to the policy index. Ids
+  // of the 2 player game fit in a byte.
+  int Id() const {
+    return (int(factory) * NUM_TILES + tile_type) * NUM_LINES + line;
+  }
+
   Position factory;
   Line line;
   Tile tile_type;
@@ -22,10 +29,74 @@ class Move {
 namespace std {
 template<>
 struct hash<Move> {
-  std::size_t operator()(const Move &move) const {
-    return move.factory * NUM_TILES * NUM_POS + move.tile_type * NUM_POS + move.line;
-  }
+  std::size_t operator()(const Move &move) const { return move.Id(); }
 };
 }
 
-using MoveList = std::array<Move, kNumMoves>;
+template <int kPlayers>
+using MoveListT = std::array<Move, GameSize<kPlayers>::kMoves>;
+using MoveList = MoveListT<2>;
+
+// Set of move ids. Every word holds two factories (2 * 30 bits) such that the
+// move id of a bit is simply word * 60 + bit.
+template <int kPositions>
+class MoveMaskT {
+ public:
+  static constexpr int kMovesPerPos = int(NUM_TILES) * NUM_LINES;
+  static constexpr int kBitsPerWord = 2 * kMovesPerPos;
+  static constexpr int kNumWords = kPositions / 2;
+  static_assert(kPositions % 2 == 0, "factories + center come in pairs");
+
+  class Iterator {
+   public:
+    Iterator(const uint64_t *bits, int word) : bits_(bits), word_(word) {
+      cur_ = word_ < kNumWords ? bits_[word_] : 0ull;
+      Advance();
+    }
+    int operator*() const {
+      return word_ * kBitsPerWord + __builtin_ctzll(cur_);
+    }
+    Iterator &operator++() {
+      cur_ &= cur_ - 1;
+      Advance();
+      return *this;
+    }
+    bool operator!=(const Iterator &it) const {
+      return word_ != it.word_ || cur_ != it.cur_;
+    }
+
+   private:
+    const uint64_t *bits_;
+    int word_;
+    uint64_t cur_;
+
+    void Advance() {
+      while (cur_ == 0ull && word_ < kNumWords) {
+        if (++word_ < kNumWords) cur_ = bits_[word_];
+      }
+    }
+  };
+
+  Iterator begin() const { return Iterator(bits, 0); }
+  Iterator end() const { return Iterator(bits, kNumWords); }
+
+  void Clear() {
+    for (auto &b : bits) b = 0ull;
+  }
+  void Set(int id) { bits[id / kBitsPerWord] |= 1ull << (id % kBitsPerWord); }
+  void Reset(int id) {
+    bits[id / kBitsPerWord] &= ~(1ull << (id % kBitsPerWord));
+  }
+  bool Test(int id) const {
+    return (bits[id / kBitsPerWord] >> (id % kBitsPerWord)) & 1ull;
+  }
+  int Count() const {
+    int n = 0;
+    for (auto b : bits) n += __builtin_popcountll(b);
+    return n;
+  }
+
+  uint64_t bits[kNumWords];
+};
+
+using MoveMask = MoveMaskT<NUM_POS>;
@@ -0,0 +1,123 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "state.h"
+#include "utils/random.h"
+
+// usage: azul_perft perft <depth> [seed]
+//        azul_perft playout [seconds] [threads] [seed]
+//
+// perft counts the leaves of the full game tree of fixed positions, every
+// round end is refilled from a seed derived from the state alone so counts
+// don't depend on the traversal order. Counts change whenever move generation
+// or Step() change behaviour.
+// playout plays random games on every thread and reports the throughput.
+
+using Clock = std::chrono::steady_clock;
+
+// factories and center, see State::FromString()
+static const char *kPositions[] = {
+    "01234012340123401234_______________",
+    "00112233440011223344_______________",
+    "0000111122223333444401234__________",
+    "________2221________44444__________",
+};
+
+static int RunPerft(int depth, uint64_t seed) {
+  for (const char *position : kPositions) {
+    printf("%s\n", position);
+    for (int d = 1; d <= depth; d++) {
+      State state;
+      utils::Random::Get().Seed(seed);
+      state.FromString(position);
+
+      auto start = Clock::now();
+      uint64_t nodes = Perft(state, d, seed);
+      std::chrono::duration<double> elapsed = Clock::now() - start;
+      printf("  depth %d %14llu nodes %8.3f s %8.2f Mnps\n", d,
+             (unsigned long long)nodes, elapsed.count(),
+             nodes / elapsed.count() / 1e6);
+    }
+  }
+  return 0;
+}
+
+struct Throughput {
+  uint64_t games{0};
+  uint64_t plies{0};
+  double seconds{0.0};
+};
+
+static void Playout(double seconds, uint64_t seed, Throughput *result) {
+  auto &random = utils::Random::Get();
+  random.Seed(seed);
+  State state;
+  MoveList moves;
+
+  auto start = Clock::now();
+  std::chrono::duration<double> elapsed{0.0};
+  while (elapsed.count() < seconds) {
+    state.Reset();
+    while (!state.IsTerminal()) {
+      int n = state.LegalMoves(moves);
+      state.Step(moves[random.GetBounded(n)]);
+      result->plies++;
+    }
+    result->games++;
+    elapsed = Clock::now() - start;
+  }
+  result->seconds = elapsed.count();
+}
+
+static int RunPlayout(double seconds, int threads, uint64_t seed) {
+  std::vector<Throughput> results(threads);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; i++) {
+    workers.emplace_back(Playout, seconds, seed + i, &results[i]);
+  }
+  for (auto &worker : workers) worker.join();
+
+  Throughput total;
+  for (int i = 0; i < threads; i++) {
+    const Throughput &r = results[i];
+    printf("thread %2d %10.0f games/s %12.0f plies/s\n", i,
+           r.games / r.seconds, r.plies / r.seconds);
+    total.games += r.games;
+    total.plies += r.plies;
+    total.seconds = std::max(total.seconds, r.seconds);
+  }
+  printf("total     %10.0f games/s %12.0f plies/s on %d threads\n",
+         total.games / total.seconds, total.plies / total.seconds, threads);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc >= 3 && strcmp(argv[1], "perft") == 0) {
+    uint64_t seed = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1;
+    return RunPerft(atoi(argv[2]), seed);
+  }
+
+  if (argc >= 2 && strcmp(argv[1], "playout") == 0) {
+    double seconds = argc > 2 ? atof(argv[2]) : 10.0;
+    int threads = argc > 3 ? atoi(argv[3]) : 0;
+    if (threads <= 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    uint64_t seed = argc > 4 ? strtoull(argv[4], nullptr, 10) : 1;
+    return RunPlayout(seconds, threads, seed);
+  }
+
+  fprintf(stderr,
+          "usage: %s perft <depth> [seed]\n"
+          "       %s playout [seconds] [threads] [seed]\n",
+          argv[0], argv[0]);
+  return 1;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "board.h"
+#include "constants.h"
+
+// Helpers to write single 5x5 input planes, shared by all plane encoders.
+// SIMD paths are selected at compile time through -march.
+
+inline constexpr int kPlaneSize = Board::SIZE * Board::SIZE;
+
+// wall square of every plane element, element i holds square 24 - i
+alignas(64) inline constexpr uint32_t kWallBits[32] = {
+    1u << 24, 1u << 23, 1u << 22, 1u << 21, 1u << 20, 1u << 19, 1u << 18,
+    1u << 17, 1u << 16, 1u << 15, 1u << 14, 1u << 13, 1u << 12, 1u << 11,
+    1u << 10, 1u << 9,  1u << 8,  1u << 7,  1u << 6,  1u << 5,  1u << 4,
+    1u << 3,  1u << 2,  1u << 1,  1u << 0,  0,        0,        0,
+    0,        0,        0,        0};
+
+// broadcasts v over a single plane
+inline void FillPlane(float *plane, float v) {
+#if defined(__AVX512F__)
+  const __m512 x = _mm512_set1_ps(v);
+  _mm512_storeu_ps(plane, x);
+  _mm512_mask_storeu_ps(plane + 16, 0x1ff, x);
+#elif defined(__AVX2__)
+  const __m256 x = _mm256_set1_ps(v);
+  _mm256_storeu_ps(plane, x);
+  _mm256_storeu_ps(plane + 8, x);
+  _mm256_storeu_ps(plane + 16, x);
+  plane[24] = v;
+#else
+  for (int i = 0; i < kPlaneSize; i++) plane[i] = v;
+#endif
+}
+
+// expands the wall bitboard into {0, 1} floats
+inline void WallPlane(float *plane, uint32_t wall) {
+#if defined(__AVX512F__)
+  const __m512i w = _mm512_set1_epi32(wall);
+  const __m512 one = _mm512_set1_ps(1.0f);
+  __mmask16 lo = _mm512_test_epi32_mask(w, _mm512_load_si512(kWallBits));
+  __mmask16 hi = _mm512_test_epi32_mask(w, _mm512_load_si512(kWallBits + 16));
+  _mm512_storeu_ps(plane, _mm512_maskz_mov_ps(lo, one));
+  _mm512_mask_storeu_ps(plane + 16, 0x1ff, _mm512_maskz_mov_ps(hi, one));
+#elif defined(__AVX2__)
+  const __m256i w = _mm256_set1_epi32(wall);
+  const __m256 one = _mm256_set1_ps(1.0f);
+  for (int i = 0; i < 24; i += 8) {
+    __m256i bits = _mm256_load_si256(
+        reinterpret_cast<const __m256i *>(kWallBits + i));
+    __m256i set = _mm256_cmpeq_epi32(_mm256_and_si256(w, bits), bits);
+    _mm256_storeu_ps(plane + i, _mm256_and_ps(_mm256_castsi256_ps(set), one));
+  }
+  plane[24] = wall & 1u;
+#else
+  for (int i = 0; i < kPlaneSize; i++) plane[i] = (wall & kWallBits[i]) != 0;
+#endif
+}
+
+// sets the first count elements of a row to the value of tile
+inline void RowPlane(float *plane, int row, int tile, int count) {
+  const float v = (tile + 1) / 5.0f;
+  for (int j = 0; j < count; j++) plane[row * Board::SIZE + j] = v;
+}
@@ -0,0 +1,114 @@
+#include "replay.h"
+
+#include <cmath>
+#include <istream>
+#include <ostream>
+
+static constexpr float kWeightScale = 65535.0f;
+
+template <typename T>
+static void Put(std::ostream &stream, T value) {
+  stream.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T>
+static bool Get(std::istream &stream, T &value) {
+  return bool(stream.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
+void Replay::Add(Move move, const Policy &pi) {
+  policies_.push_back(pi);
+  Ply ply;
+  ply.move = move.Id();
+  for (int a = 0; a < kNumMoves; a++) {
+    const long w = std::lround(pi[a] * kWeightScale);
+    if (w > 0) ply.weights.emplace_back(a, w);
+  }
+  plies_.push_back(std::move(ply));
+}
+
+void Replay::Write(std::ostream &stream) const {
+  Put<uint32_t>(stream, kMagic);
+  Put<uint16_t>(stream, kVersion);
+  Put<uint64_t>(stream, seed_);
+  Put<uint8_t>(stream, result_);
+  Put<uint16_t>(stream, plies_.size());
+  for (const Ply &ply : plies_) {
+    Put<uint8_t>(stream, ply.move);
+    Put<uint8_t>(stream, ply.weights.size());
+    for (const auto &w : ply.weights) {
+      Put<uint8_t>(stream, w.first);
+      Put<uint16_t>(stream, w.second);
+    }
+  }
+}
+
+bool Replay::Read(std::istream &stream) {
+  uint32_t magic;
+  uint16_t version, num_plies;
+  uint8_t result, n;
+  policies_.clear();
+  if (!Get(stream, magic) || !Get(stream, version)) return false;
+  // the game of another engine version replays to other states
+  if (magic != kMagic || version != kVersion) return false;
+  if (!Get(stream, seed_) || !Get(stream, result) || !Get(stream, num_plies)) {
+    return false;
+  }
+  if (result > State::PLAYER2) return false;
+  result_ = State::Result(result);
+  plies_.resize(num_plies);
+  for (Ply &ply : plies_) {
+    if (!Get(stream, ply.move) || !Get(stream, n)) return false;
+    // every policy has a move with visits, ids index the 180 moves
+    if (ply.move >= kNumMoves || n == 0) return false;
+    ply.weights.resize(n);
+    for (auto &w : ply.weights) {
+      if (!Get(stream, w.first) || !Get(stream, w.second)) return false;
+      if (w.first >= kNumMoves || w.second == 0) return false;
+    }
+  }
+  return true;
+}
+
+bool Replay::Expand(std::vector<Datapoint> *records) const {
+  records->resize(plies_.size());
+  utils::Xoshiro256 rng = Rng();
+  State state;
+  state.Reset(rng);
+  for (size_t i = 0; i < plies_.size(); i++) {
+    const Ply &ply = plies_[i];
+    Datapoint &record = (*records)[i];
+    record.state = state;
+    if (!policies_.empty()) {
+      record.pi = policies_[i];
+    } else {
+      record.pi.fill(0.0f);
+      float sum = 0.0f;
+      for (const auto &w : ply.weights) sum += w.second;
+      for (const auto &w : ply.weights) record.pi[w.first] = w.second / sum;
+    }
+
+    if (result_ == State::DRAW) {
+      record.z = 0;
+    } else {
+      record.z = state.Turn() + 1 == result_ ? 1 : -1;
+    }
+
+    if (!state.LegalMask().Test(ply.move)) {
+      records->resize(i);
+      return false;
+    }
+    state.Step(Move(ply.move), rng);
+  }
+  return true;
+}
+
+void Replay::WriteRecords(const std::vector<Datapoint> &records,
+                          std::ostream &stream) {
+  for (const Datapoint &record : records) {
+    stream << record.state.Serialize();
+    stream.write(reinterpret_cast<const char *>(record.pi.data()),
+                 record.pi.size() * sizeof(record.pi[0]));
+    Put<int8_t>(stream, record.z);
+  }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <iosfwd>
+#include <utility>
+#include <vector>
+
+#include "constants.h"
+#include "move.h"
+#include "state.h"
+#include "utils/random.h"
+
+// Self-play game stored as the seed of its refills, the moves and the search
+// policy of every ply. All states follow from replaying the moves with
+// State::Step(move, rng), so a game takes a few KB instead of the ~56 KB of
+// expanded (state, pi, z) records.
+//
+// Binary layout, native byte order:
+//   u32 magic, u16 version, u64 seed, u8 result, u16 plies, then for every
+//   ply u8 move, u8 n, n x (u8 move id, u16 weight)
+// The weights are the policy scaled to 65535, moves without visits are left
+// out. A game only replays with the refills of the engine that recorded it,
+// kVersion changes with the format or with anything that changes the draws
+// of Reset() and Step().
+class Replay {
+ public:
+  using Policy = std::array<float, kNumMoves>;
+
+  static constexpr uint32_t kMagic = 0x52415a41;  ///< "AZAR"
+  static constexpr uint16_t kVersion = 1;
+
+  struct Datapoint {
+    State state;
+    Policy pi;
+    int8_t z;  ///< outcome for the player to move, 1, 0 or -1
+  };
+
+  Replay() = default;
+  explicit Replay(uint64_t seed) : seed_(seed) {}
+
+  // generator of the refills, Reset() and Step() the game state with it
+  utils::Xoshiro256 Rng() const { return utils::Xoshiro256(seed_); }
+  // appends the move played and the policy it was picked from
+  void Add(Move move, const Policy &pi);
+  void SetResult(State::Result result) { result_ = result; }
+  int Plies() const { return plies_.size(); }
+
+  void Write(std::ostream &stream) const;
+  // false on end of stream, a truncated game or one that isn't a replay of
+  // this version: a bad header, move ids beyond kNumMoves, a ply without
+  // weights or a bad result. Callers tell the end of a stream from a game
+  // cut short by peeking before the next Read().
+  bool Read(std::istream &stream);
+  // regenerates the records of every ply by replaying the game, false if a
+  // move is illegal in its state. The policies are exact for a game recorded
+  // with Add(), a game that was Read() has the 16 bit weights only.
+  bool Expand(std::vector<Datapoint> *records) const;
+  // records in the layout the training scripts read: packed state, policy
+  // and outcome
+  static void WriteRecords(const std::vector<Datapoint> &records,
+                           std::ostream &stream);
+
+ private:
+  struct Ply {
+    uint8_t move;
+    std::vector<std::pair<uint8_t, uint16_t>> weights;
+  };
+
+  uint64_t seed_{0};
+  State::Result result_{State::DRAW};
+  std::vector<Ply> plies_;
+  // policies as passed to Add(), not stored in the stream
+  std::vector<Policy> policies_;
+};
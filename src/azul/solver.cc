@@ -0,0 +1,75 @@
+#include "solver.h"
+
+#include <algorithm>
+
+bool Solver::Solve(State &state, int *value, Move *best, int budget) {
+  budget_ = budget;
+  nodes_ = 0;
+  if (state.IsTerminal() || !state.IsFinalRound()) return false;
+
+  uint8_t move;
+  if (!Search(state, -1, 1, value, &move)) return false;
+  if (best) *best = Move(move);
+  return true;
+}
+
+bool Solver::Search(State &state, int alpha, int beta, int *value,
+                    uint8_t *best) {
+  if (++nodes_ > budget_) return false;
+
+  const uint64_t hash = std::hash<State>()(state);
+  uint8_t first = 0;
+  bool known = false;
+  Entry &entry = table_[hash & (table_.size() - 1)];
+  if (entry.bound != NONE && entry.hash == hash) {
+    if (entry.bound == EXACT ||
+        (entry.bound == LOWER && entry.value >= beta) ||
+        (entry.bound == UPPER && entry.value <= alpha)) {
+      *value = entry.value;
+      *best = entry.move;
+      return true;
+    }
+    first = entry.move;
+    known = true;
+  }
+
+  // best move of an earlier search first, then by move id
+  MoveList moves;
+  int n = state.LegalMoves(moves);
+  if (known) {
+    auto m = std::find_if(moves.begin(), moves.begin() + n,
+                          [&](Move move) { return move.Id() == first; });
+    if (m != moves.begin() + n) std::rotate(moves.begin(), m, m + 1);
+  }
+
+  const int alpha0 = alpha;
+  int vbest = -2;
+  for (int i = 0; i < n && vbest < beta; i++) {
+    int v;
+    auto record = state.Play(moves[i]);
+    if (state.IsTerminal()) {
+      v = state.Outcome();
+    } else {
+      // every round end is terminal, so the turn alternates until then
+      uint8_t reply;
+      if (!Search(state, -beta, -alpha, &v, &reply)) {
+        state.Undo(record);
+        return false;
+      }
+      v = -v;
+    }
+    state.Undo(record);
+
+    if (v > vbest) {
+      vbest = v;
+      *best = moves[i].Id();
+      alpha = std::max(alpha, v);
+    }
+  }
+
+  Bound bound = vbest <= alpha0 ? UPPER : vbest >= beta ? LOWER : EXACT;
+  // replaces whatever a state below this one left in the slot
+  entry = {hash, int8_t(vbest), bound, *best};
+  *value = vbest;
+  return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "move.h"
+#include "state.h"
+
+// Exact alpha-beta search of the final round. Once a full pattern line
+// completes a wall row no refill follows, so the rest of the game has perfect
+// information and every outcome can be searched to the end.
+class Solver {
+ public:
+  static constexpr int kDefaultBudget = 1 << 16;
+  // entries of the table, a solver takes 16 bytes per entry
+  static constexpr int kTableSize = 1 << 14;
+
+  Solver() : table_(kTableSize) {}
+
+  // exact outcome (-1, 0 or 1) for the player to move and a move reaching it,
+  // false if the state isn't in the final round or more than budget nodes are
+  // needed
+  bool Solve(State &state, int *value, Move *best = nullptr,
+             int budget = kDefaultBudget);
+  // nodes searched by the last Solve()
+  int Nodes() const { return nodes_; }
+  void Clear() { std::fill(table_.begin(), table_.end(), Entry{}); }
+
+ private:
+  enum Bound : uint8_t { NONE, EXACT, LOWER, UPPER };
+
+  struct Entry {
+    uint64_t hash{0};
+    int8_t value{0};
+    Bound bound{NONE};
+    uint8_t move{0};  ///< best move id, tried first on the next visit
+  };
+
+  // outcomes of finished searches, valid for every later Solve(). Indexed by
+  // the low bits of the hash, a new entry replaces the one in its place so
+  // the table keeps its size over a whole game.
+  std::vector<Entry> table_;
+  int budget_{0};
+  int nodes_{0};
+
+  // returns false if the budget ran out, value is undefined then
+  bool Search(State &state, int alpha, int beta, int *value, uint8_t *best);
+};
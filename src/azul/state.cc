@@ -1,252 +1,519 @@
 #include "state.h"
 
 #include <glog/logging.h>
+#include <string.h>
 
-#include <sstream>
+#include <algorithm>
+#include <utility>
 
-State::State() : center_(bag_), boards_{bag_, bag_} { Reset(); }
+#include "planes.h"
+#include "utils/random.h"
+#include "zobrist.h"
 
-State::State(const State &s) : center_(bag_), boards_{bag_, bag_} { *this = s; }
+// pattern lines, row i holds count tiles from the left
+static inline void LeftPlane(float *plane, const Board &board) {
+  FillPlane(plane, 0.0f);
+  for (int i = 0; i < Board::SIZE; i++) {
+    RowPlane(plane, i, board.left[i].tile_type, board.left[i].count);
+  }
+}
 
-int State::LegalMoves(MoveList &moves) {
-  int i = 0;
-  Board &b = boards_[turn_];
+template <int kPlayers>
+StateT<kPlayers>::StateT() {
+  for (int p = 0; p < kPlayers; p++) boards_[p] = Board(p);
+  Reset();
+}
 
-  for (int pos = 0; pos < NUM_POS; pos++) {
+// expands a 5 bit tile presence mask into 6 line bits per present tile
+static constexpr std::array<uint32_t, 1 << NUM_TILES> MakeTileGroups() {
+  std::array<uint32_t, 1 << NUM_TILES> groups{};
+  for (int present = 0; present < (1 << NUM_TILES); present++) {
     for (int tile = 0; tile < NUM_TILES; tile++) {
-      int num = center_.Count(Position(pos), Tile(tile));
-      if (num > 0) {
-        for (int line = 0; line < NUM_LINES - 1; line++) {
-          // if there's space on the left
-          if (b.left[line].count < line + 1) {
-            // if the left is empty or the tiles are of the current type
-            if (b.left[line].tile_type == tile || b.left[line].count == 0) {
-              // if the wall doesn't have the current tile yet
-              if (!b.WallHasTile(Tile(tile), Line(line))) {
-                Move &m = moves[i];
-                m.factory = Position(pos);
-                m.tile_type = Tile(tile);
-                m.line = Line(line);
-                i++;
-              }
-            }
-          }
-        }
-
-        // we can always add tiles to the floorline
-        Move &m = moves[i];
-        m.factory = Position(pos);
-        m.tile_type = Tile(tile);
-        m.line = FLOORLINE;
-        i++;
+      if (present & (1 << tile)) {
+        groups[present] |= 0x3fu << (tile * NUM_LINES);
       }
     }
   }
+  return groups;
+}
+
+static constexpr auto kTileGroups = MakeTileGroups();
+
+template <int kPlayers>
+auto StateT<kPlayers>::LegalMask() const -> MoveMask {
+  MoveMask mask;
+  uint64_t lines = boards_[turn_].LegalLines();
+
+  for (int w = 0; w < MoveMask::kNumWords; w++) {
+    const Holder &lo = center_.holders[2 * w];
+    const Holder &hi = center_.holders[2 * w + 1];
+    uint64_t a = kTileGroups[lo.Present()] & lines;
+    uint64_t b = kTileGroups[hi.Present()] & lines;
+    mask.bits[w] = a | b << MoveMask::kMovesPerPos;
+  }
+
+  return mask;
+}
+
+template <int kPlayers>
+auto StateT<kPlayers>::PruneFloorOverflow(MoveMask legal) const -> MoveMask {
+  const Board &board = boards_[turn_];
+  auto penalty = [](int floorline) {
+    return Board::kPenalty[std::min(floorline, Board::kFloorLineSize)];
+  };
+
+  for (int pos = 0; pos < Center::NUM_POS; pos++) {
+    int floorline = board.floorline;
+    // the first tile goes to the floor line whatever the placement
+    if (pos == Center::CENTER && center_.first == -1) floorline++;
 
+    for (int tile = 0; tile < NUM_TILES; tile++) {
+      const int n = center_.holders[pos].counts_[tile];
+      if (n == 0) continue;
+
+      // floor penalty of every pattern line, a FLOORLINE dump is never
+      // dropped
+      const int id = Move(Position(pos), Tile(tile), LINE1).Id();
+      int cost[FLOORLINE] = {}, best = penalty(floorline + n);
+      for (int line = 0; line < FLOORLINE; line++) {
+        if (!legal.Test(id + line)) continue;
+        int space = line + 1 - board.left[line].count;
+        cost[line] = penalty(floorline + std::max(0, n - space));
+        best = std::min(best, cost[line]);
+      }
+      for (int line = 0; line < FLOORLINE; line++) {
+        if (legal.Test(id + line) && cost[line] > best) legal.Reset(id + line);
+      }
+    }
+  }
+  return legal;
+}
+
+template <int kPlayers>
+int StateT<kPlayers>::LegalMoves(MoveList &moves) {
+  int i = 0;
+  for (int id : LegalMask()) moves[i++] = Move(id);
   return i;
 }
 
-void State::FromString(const std::string center) {
+template <int kPlayers>
+void StateT<kPlayers>::FromString(const std::string center) {
   Reset();
   center_.CenterFromString(center);
+  hash_ = ComputeHash();
+}
+
+template <int kPlayers>
+void StateT<kPlayers>::Reset() {
+  Reset(utils::Random::Get().Fast());
 }
 
-void State::Reset() {
+template <int kPlayers>
+void StateT<kPlayers>::Reset(utils::Xoshiro256 &rng) {
   turn_ = 0;
   bag_.Reset();
-  center_.Reset();
-  boards_[0].Reset();
-  boards_[1].Reset();
+  center_.Clear();
+  for (auto &board : boards_) board.Reset();
+  hash_ = ComputeHash();
+  ApplyChance(SampleChance(rng));
 }
 
-void State::Step(const Move move) {
-  int num = center_.TakeTiles(Position(move.factory), Tile(move.tile_type));
-  boards_[turn_].ApplyMove(move, num);
+template <int kPlayers>
+auto StateT<kPlayers>::Step(const Move move) -> UndoRecord {
+  return Step(move, utils::Random::Get().Fast());
+}
+
+template <int kPlayers>
+auto StateT<kPlayers>::Step(const Move move, utils::Xoshiro256 &rng)
+    -> UndoRecord {
+  UndoRecord record = Play(move);
+  if (record.round_over) ApplyChance(SampleChance(rng));
+  return record;
+}
 
-  if (center_.first == -1 && move.factory == CENTER) {
+template <int kPlayers>
+auto StateT<kPlayers>::Play(const Move move) -> UndoRecord {
+  Board &board = boards_[turn_];
+  UndoRecord record;
+  record.hash = hash_;
+  record.move = move;
+  record.holder = center_.holders[move.factory];
+  if (move.line < FLOORLINE) record.line = board.left[move.line];
+  record.floorline = board.floorline;
+  record.first = center_.first;
+  record.turn = turn_;
+  record.prev_turn = prev_turn_;
+
+  int num = center_.TakeTiles(Position(move.factory), Tile(move.tile_type),
+                              hash_);
+  board.ApplyMove(move, num, bag_, hash_);
+  record.returned = board.floorline - record.floorline;
+
+  if (center_.first == -1 && move.factory == Center::CENTER) {
+    hash_ ^= zobrist::First(-1) ^ zobrist::First(turn_);
     center_.first = turn_;
-    boards_[turn_].IncreaseFloorline();
+    board.IncreaseFloorline(hash_);
   }
 
   prev_turn_ = turn_;
-  if (center_.IsRoundOver()) {
+  hash_ ^= zobrist::Turn(turn_);
+  record.round_over = center_.IsRoundOver();
+  if (record.round_over) {
     // It's theoretically possible to have no tiles in the center the entire
     // round. When each factory has 4 tiles of the same type.
     turn_ = center_.first == -1 ? 0 : center_.first;
-    boards_[0].NextRound();
-    boards_[1].NextRound();
-    center_.NextRound();
+    record.bag = bag_;
+    for (int p = 0; p < kPlayers; p++) {
+      record.rounds[p] = boards_[p].NextRound(bag_, hash_);
+    }
+    hash_ ^= zobrist::First(center_.first) ^ zobrist::First(-1);
+    center_.first = -1;
   } else {
-    turn_ ^= 1u;
+    turn_ = Next(turn_);
   }
+  hash_ ^= zobrist::Turn(turn_);
+
+  DCHECK_EQ(hash_, ComputeHash()) << "Incremental hash diverged";
+  return record;
 }
 
-std::string State::Serialize() const {
-  // NOTE: Order matters here
-  std::stringstream ss;
-  uint8_t s;
+template <int kPlayers>
+bool StateT<kPlayers>::IsChance() const {
+  for (const Holder &holder : center_.holders) {
+    if (holder.Present()) return false;
+  }
+  return true;
+}
 
-  // factories + center 6*5 bytes
-  ss.write(reinterpret_cast<const char *>(&center_.holders),
-           sizeof(center_.holders));
+template <int kPlayers>
+auto StateT<kPlayers>::SampleChance() const -> Chance {
+  return SampleChance(utils::Random::Get().Fast());
+}
 
-  // bag 5 bytes
-  ss.write(reinterpret_cast<const char *>(&bag_.tiles), sizeof(bag_.tiles));
+template <int kPlayers>
+auto StateT<kPlayers>::SampleChance(utils::Xoshiro256 &rng) const -> Chance {
+  Chance chance;
+  Bag bag = bag_;
+  uint64_t hash = 0;
+  for (Holder &factory : chance.factories) {
+    bag.Draw(Center::NUM_TILES_PER_FACTORY, factory.counts_, hash, rng);
+  }
+  return chance;
+}
 
-  // turn 1 byte
-  ss.write(reinterpret_cast<const char *>(&turn_), 1);
-
-  // left 5*2 bytes p1 & p2
-  ss.write(reinterpret_cast<const char *>(&boards_[0].left),
-           sizeof(boards_[0].left));
-  ss.write(reinterpret_cast<const char *>(&boards_[1].left),
-           sizeof(boards_[1].left));
-
-  // wall 4 bytes p1 & p2
-  ss.write(reinterpret_cast<const char *>(&boards_[0].wall),
-           sizeof(boards_[0].wall));
-  ss.write(reinterpret_cast<const char *>(&boards_[1].wall),
-           sizeof(boards_[1].wall));
-
-  // floorline 1 byte p1 & p2
-  ss.write(reinterpret_cast<const char *>(&boards_[0].floorline), 1);
-  ss.write(reinterpret_cast<const char *>(&boards_[1].floorline), 1);
-
-  // scores 2 bytes
-  s = boards_[0].Score();
-  ss.write(reinterpret_cast<char *>(&s), sizeof(s));
-  s = boards_[1].Score();
-  ss.write(reinterpret_cast<char *>(&s), sizeof(s));
+template <int kPlayers>
+void StateT<kPlayers>::ApplyChance(const Chance &chance) {
+  DCHECK(IsChance());
+  uint8_t drawn[NUM_TILES] = {};
+  for (int i = 0; i < Center::NUM_FACTORIES; i++) {
+    const Holder &factory = chance.factories[i];
+    center_.holders[i] = factory;
+    hash_ ^= factory.Hash(Position(i));
+    for (int t = 0; t < NUM_TILES; t++) drawn[t] += factory.counts_[t];
+  }
+  bag_.Remove(drawn, hash_);
+  DCHECK_EQ(hash_, ComputeHash()) << "Chance hash diverged";
+}
+
+template <int kPlayers>
+void StateT<kPlayers>::Undo(const UndoRecord &record) {
+  const Move &move = record.move;
+
+  if (record.round_over) {
+    // the factories were empty before the refill
+    for (int i = 0; i < Center::NUM_FACTORIES; i++) center_.holders[i].Clear();
+    for (int p = 0; p < kPlayers; p++) boards_[p].UndoRound(record.rounds[p]);
+    bag_ = record.bag;
+  }
+
+  Board &board = boards_[record.turn];
+  if (move.line < FLOORLINE) board.left[move.line] = record.line;
+  board.floorline = record.floorline;
+  bag_.Return(Tile(move.tile_type), -record.returned);
+
+  // remaining factory tiles were moved to the center
+  if (move.factory != Center::CENTER) {
+    for (int t = 0; t < NUM_TILES; t++) {
+      if (t == move.tile_type) continue;
+      center_.holders[Center::CENTER].counts_[t] -= record.holder.counts_[t];
+    }
+  }
+  center_.holders[move.factory] = record.holder;
+  center_.first = record.first;
+
+  turn_ = record.turn;
+  prev_turn_ = record.prev_turn;
+  hash_ = record.hash;
+  DCHECK_EQ(hash_, ComputeHash()) << "Undo hash mismatch";
+}
+
+template <int kPlayers>
+uint64_t StateT<kPlayers>::ComputeHash() const {
+  uint64_t hash = zobrist::Turn(turn_);
+  hash ^= bag_.Hash();
+  hash ^= center_.Hash();
+  for (const auto &board : boards_) hash ^= board.Hash();
+  return hash;
+}
+
+template <int kPlayers>
+StateT<kPlayers> StateT<kPlayers>::Canonical(FactoryMap *map) const {
+  // 3 bits per tile count, empty factories sort first
+  uint32_t keys[Center::NUM_FACTORIES];
+  uint8_t order[Center::NUM_FACTORIES];
+  for (int i = 0; i < Center::NUM_FACTORIES; i++) {
+    const uint8_t *counts = center_.holders[i].counts_;
+    keys[i] = 0;
+    for (int t = 0; t < NUM_TILES; t++) keys[i] = keys[i] << 3 | counts[t];
+    order[i] = i;
+  }
 
+  // insertion sort, stable so equal factories keep their order
+  for (int i = 1; i < Center::NUM_FACTORIES; i++) {
+    for (int j = i; j > 0 && keys[order[j - 1]] > keys[order[j]]; j--) {
+      std::swap(order[j - 1], order[j]);
+    }
+  }
+
+  StateT state = *this;
+  for (int i = 0; i < Center::NUM_FACTORIES; i++) {
+    map->from[i] = order[i];
+    map->to[order[i]] = i;
+    if (order[i] == i) continue;
+    const Holder &holder = center_.holders[order[i]];
+    state.hash_ ^= center_.holders[i].Hash(Position(i)) ^
+                   holder.Hash(Position(i));
+    state.center_.holders[i] = holder;
+  }
+  map->from[Center::CENTER] = map->to[Center::CENTER] = Center::CENTER;
+  DCHECK(state.hash_ == state.ComputeHash());
+  return state;
+}
+
+template <int kPlayers>
+void StateT<kPlayers>::Pack(uint8_t *record) const {
+  // NOTE: Order matters here, the 2 player layout is read by generator.py
+  uint8_t *p = record;
+  auto write = [&p](const void *src, size_t n) {
+    memcpy(p, src, n);
+    p += n;
+  };
+
+  // factories + center 6*5 bytes
+  write(&center_.holders, sizeof(center_.holders));
+  // bag 5 bytes
+  write(&bag_.tiles, sizeof(bag_.tiles));
+  // turn 1 byte
+  write(&turn_, 1);
+  // left 5*2 bytes per player
+  for (const auto &board : boards_) write(&board.left, sizeof(board.left));
+  // wall 4 bytes per player
+  for (const auto &board : boards_) write(&board.wall, sizeof(board.wall));
+  // floorline 1 byte per player
+  for (const auto &board : boards_) write(&board.floorline, 1);
+  // scores 1 byte per player
+  for (const auto &board : boards_) *p++ = board.Score();
   // first tile 1 byte
-  ss.write(reinterpret_cast<const char *>(&center_.first), 1);
+  write(&center_.first, 1);
 
-  auto str = ss.str();
-  CHECK(str.size() == 69);
-  return str;
+  DCHECK(p == record + kRecordSize);
 }
 
-void State::MakePlanes(float *planes) {
+template <int kPlayers>
+void StateT<kPlayers>::Unpack(const uint8_t *record) {
+  Read(record);
+  hash_ = ComputeHash();
+}
+
+template <int kPlayers>
+void StateT<kPlayers>::Read(const uint8_t *record) {
+  const uint8_t *p = record;
+  auto read = [&p](void *dst, size_t n) {
+    memcpy(dst, p, n);
+    p += n;
+  };
+
+  read(&center_.holders, sizeof(center_.holders));
+  read(&bag_.tiles, sizeof(bag_.tiles));
+  bag_.size_ = 0;
+  for (int i = 0; i < NUM_TILES; i++) {
+    bag_.size_ += bag_.tiles[i];
+    bag_.returned_[i] = 0;
+  }
+  read(&turn_, 1);
+  prev_turn_ = turn_;
+
+  for (auto &board : boards_) read(&board.left, sizeof(board.left));
+  for (auto &board : boards_) read(&board.wall, sizeof(board.wall));
+  for (auto &board : boards_) read(&board.floorline, 1);
+  for (auto &board : boards_) {
+    board.score_ = *p++;
+    board.terminal_ = false;
+    for (uint32_t row : Board::kRows) {
+      if ((board.wall & row) == row) board.terminal_ = true;
+    }
+  }
+  read(&center_.first, 1);
+}
+
+template <int kPlayers>
+std::string StateT<kPlayers>::Serialize() const {
+  Record record;
+  Pack(record.data());
+  return std::string(record.begin(), record.end());
+}
+
+template <int kPlayers>
+void StateT<kPlayers>::Deserialize(const std::string &bytes) {
+  CHECK(bytes.size() == kRecordSize);
+  Unpack(reinterpret_cast<const uint8_t *>(bytes.data()));
+}
+
+template <int kPlayers>
+void StateT<kPlayers>::MakePlanes(const Record *records, int num,
+                                  float *planes) {
+  // planes don't need the hash and a fresh state would draw from the bag
+  StateT state{Blank()};
+  for (int i = 0; i < num; i++) {
+    state.Read(records[i].data());
+    state.EncodePlanes(&planes[i * Size::kPlanes * kPlaneSize]);
+  }
+}
+
+template <int kPlayers>
+void StateT<kPlayers>::MakePlanes(float *planes) const {
+  MakePlanes(this, 1, planes);
+}
+
+template <int kPlayers>
+void StateT<kPlayers>::MakePlanes(const StateT *states, int num,
+                                  float *planes) {
+  for (int i = 0; i < num; i++) {
+    states[i].EncodePlanes(&planes[i * Size::kPlanes * kPlaneSize]);
+  }
+}
+
+template <int kPlayers>
+void StateT<kPlayers>::EncodePlanes(float *planes) const {
   // NOTE(Folkert): Order matters! Should be equal to training/generator.py
+  // Every plane is written exactly once, empty planes are filled with zeros.
+  // The player to move comes first, the others follow in turn order.
+  float *plane = planes;
 
   // scores
-  memset(planes, 0, sizeof(float) * kNumPlanes * Board::SIZE * Board::SIZE);
-  int idx = 0;
-  SetPlane(&planes[idx], boards_[turn_].Score() / 255.0f);
-  idx++;
-  SetPlane(&planes[idx], boards_[1 ^ turn_].Score() / 255.0f);
-  idx++;
+  for (int p = 0, q = turn_; p < kPlayers; p++, q = Next(q)) {
+    FillPlane(plane, boards_[q].Score() / 255.0f);
+    plane += kPlaneSize;
+  }
 
   // bag
   for (int t = 0; t < NUM_TILES; t++) {
-    SetPlane(&planes[idx * 25], bag_.tiles[t] / 20.0f);
-    idx++;
+    FillPlane(plane, bag_.tiles[t] / 20.0f);
+    plane += kPlaneSize;
   }
 
   // factories + center
-  for (int f = 0; f < NUM_POS; f++) {
-    int empty = (f == CENTER ? 15 : 4);
+  for (int f = 0; f < Center::NUM_POS; f++) {
+    int empty = (f == Center::CENTER ? Center::NUM_CENTER
+                                     : Center::NUM_TILES_PER_FACTORY);
     for (int t = 0; t < NUM_TILES; t++) {
-      for (int j = 0; j < center_.Count(Position(f), Tile(t)); j++) {
-        SetPlane(&planes[idx * 25], (t + 1) / 5.0f);
+      for (int j = 0; j < center_.holders[f].counts_[t]; j++) {
+        FillPlane(plane, (t + 1) / 5.0f);
+        plane += kPlaneSize;
         empty--;
-        idx++;
       }
     }
-    for (int e = 0; e < empty; e++) idx++;
-  }
-
-  // first tile
-  SetPlane(&planes[idx * 25], (center_.first + 1) / 2.0f);
-  idx++;
-
-  // me left
-  for (int i = 0; i <= LINE5; i++) {
-    for (int j = 0; j < boards_[turn_].left[i].count; j++) {
-      planes[idx * 25 + i * 5 + j] =
-          (boards_[turn_].left[i].tile_type + 1) / 5.0f;
+    for (int e = 0; e < empty; e++) {
+      FillPlane(plane, 0.0f);
+      plane += kPlaneSize;
     }
   }
-  idx++;
-
-  // me wall
-  for (int i = 0; i < 25; i++)
-    planes[idx * 25 + i] = (boards_[turn_].wall >> (24 - i)) & 1;
-  idx++;
-
-  // me floor
-  SetPlane(&planes[idx * 25], boards_[turn_].floorline / 7.0f);
-  idx++;
 
-  // op left
-  for (int i = 0; i <= LINE5; i++) {
-    for (int j = 0; j < boards_[1 ^ turn_].left[i].count; j++) {
-      planes[idx * 25 + i * 5 + j] =
-          (boards_[1 ^ turn_].left[i].tile_type + 1) / 5.0f;
-    }
+  // first tile
+  FillPlane(plane, (center_.first + 1) / float(kPlayers));
+  plane += kPlaneSize;
+
+  // left, wall, floor of every player
+  for (int p = 0, q = turn_; p < kPlayers; p++, q = Next(q)) {
+    const Board &board = boards_[q];
+    LeftPlane(plane, board);
+    plane += kPlaneSize;
+    WallPlane(plane, board.wall);
+    plane += kPlaneSize;
+    FillPlane(plane, board.floorline / 7.0f);
+    plane += kPlaneSize;
   }
-  idx++;
-
-  // op wall
-  for (int i = 0; i < 25; i++)
-    planes[idx * 25 + i] = (boards_[1 ^ turn_].wall >> (24 - i)) & 1;
-  idx++;
 
-  // op floor
-  SetPlane(&planes[idx * 25], boards_[1 ^ turn_].floorline / 7.0f);
-  idx++;
-
-  CHECK(idx == kNumPlanes) << "Invalid plane count " << idx
-                           << " != " << kNumPlanes;
+  DCHECK(plane == planes + Size::kPlanes * kPlaneSize)
+      << "Invalid plane count " << (plane - planes) / kPlaneSize
+      << " != " << Size::kPlanes;
 }
 
-int State::Outcome() {
-  int me = boards_[prev_turn_].Score();
-  int op = boards_[1u ^ prev_turn_].Score();
-  if (me > op) return 1;
-  if (me < op) return -1;
+template <int kPlayers>
+int StateT<kPlayers>::Outcome() {
+  int me = boards_[prev_turn_].Score(), best = 0;
+  for (int p = 0; p < kPlayers; p++) {
+    if (p != prev_turn_) best = std::max(best, int(boards_[p].Score()));
+  }
+  if (me > best) return 1;
+  if (me < best) return -1;
   return 0;
 }
 
-bool State::IsTerminal() {
-  return boards_[0].IsTerminal() || boards_[1].IsTerminal();
+template <int kPlayers>
+bool StateT<kPlayers>::IsTerminal() {
+  for (auto &board : boards_) {
+    if (board.IsTerminal()) return true;
+  }
+  return false;
 }
 
-State &State::operator=(const State &s) {
-  if (this == &s) {
-    return *this;
+template <int kPlayers>
+bool StateT<kPlayers>::IsFinalRound() const {
+  for (const auto &board : boards_) {
+    if (board.CompletesRow()) return true;
   }
+  return false;
+}
 
-  bag_ = s.bag_;
-  center_ = s.center_;
-  boards_[0] = s.boards_[0];
-  boards_[1] = s.boards_[1];
-  turn_ = s.turn_;
+template <int kPlayers>
+auto StateT<kPlayers>::Winner() -> Result {
+  CHECK(IsTerminal());
 
-  return *this;
+  int winner = 0, ties = 0;
+  for (int p = 1; p < kPlayers; p++) {
+    if (boards_[p].Score() > boards_[winner].Score()) {
+      winner = p;
+      ties = 0;
+    } else if (boards_[p].Score() == boards_[winner].Score()) {
+      ties++;
+    }
+  }
+
+  if (ties > 0) return DRAW;
+  return Result(PLAYER1 + winner);
 }
 
-State::Result State::Winner() {
-  CHECK(IsTerminal());
+template class StateT<2>;
+template class StateT<3>;
+template class StateT<4>;
 
-  int a = boards_[prev_turn_].Score();
-  int b = boards_[1u ^ prev_turn_].Score();
+uint64_t Perft(State &state, int depth, uint64_t seed) {
+  if (depth == 0 || state.IsTerminal()) return 1;
 
-  if (a == b) return DRAW;
+  MoveList moves;
+  int n = state.LegalMoves(moves);
+  if (depth == 1) return n;
 
-  if (prev_turn_ == 0) {
-    if (a > b)
-      return PLAYER1;
-    else
-      return PLAYER2;
-  } else {
-    if (a > b)
-      return PLAYER2;
-    else
-      return PLAYER1;
+  uint64_t nodes = 0;
+  for (int i = 0; i < n; i++) {
+    auto record = state.Play(moves[i]);
+    if (state.IsChance() && !state.IsTerminal()) {
+      utils::Xoshiro256 rng(seed ^ std::hash<State>()(state));
+      state.ApplyChance(state.SampleChance(rng));
+    }
+    nodes += Perft(state, depth - 1, seed);
+    state.Undo(record);
   }
-}
-
-void State::SetPlane(float *plane, float v) {
-  for (int i = 0; i < Board::SIZE * Board::SIZE; i++) plane[i] = v;
+  return nodes;
 }
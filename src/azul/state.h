@@ -4,6 +4,7 @@
 
 #include <array>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
@@ -12,39 +13,171 @@
 #include "constants.h"
 #include "move.h"
 
-class State {
+// Factories are interchangeable, the canonical form of a state sorts them by
+// content so transposed states share one hash and one network evaluation.
+// FactoryMap translates moves between a state and its canonical form.
+template <int kPositions>
+struct FactoryMapT {
+  uint8_t to[kPositions];    ///< canonical position of every factory
+  uint8_t from[kPositions];  ///< original position of every canonical factory
+
+  int ToCanonical(int id) const { return Map(to, id); }
+  int FromCanonical(int id) const { return Map(from, id); }
+  Move ToCanonical(Move move) const { return Move(ToCanonical(move.Id())); }
+  Move FromCanonical(Move move) const { return Move(FromCanonical(move.Id())); }
+
+ private:
+  static int Map(const uint8_t *pos, int id) {
+    constexpr int n = int(NUM_TILES) * NUM_LINES;
+    return pos[id / n] * n + id % n;
+  }
+};
+
+using FactoryMap = FactoryMapT<NUM_POS>;
+
+// Game state for kPlayers players, every size is a compile time constant.
+// State is the 2 player game used by search and self-play.
+template <int kPlayers>
+class StateT {
  public:
-  enum Result { DRAW, PLAYER1, PLAYER2 };
-  friend struct std::hash<State>;
+  using Size = GameSize<kPlayers>;
+  using Center = CenterT<kPlayers>;
+  using MoveMask = MoveMaskT<Size::kPositions>;
+  using MoveList = MoveListT<kPlayers>;
+  using FactoryMap = FactoryMapT<Size::kPositions>;
+
+  // bytes of a packed state, 69 for 2 players
+  static constexpr int kRecordSize =
+      Center::NUM_POS * NUM_TILES + NUM_TILES + 2 + 16 * kPlayers;
+  using Record = std::array<uint8_t, kRecordSize>;
 
-  State();
-  State(const State &s);
+  // DRAW or the winning player + 1
+  enum Result { DRAW, PLAYER1, PLAYER2, PLAYER3, PLAYER4 };
+  friend struct std::hash<StateT>;
+  friend class GameBatch;
+
+  // random part of a round end: the refilled factories
+  struct Chance {
+    Holder factories[Center::NUM_FACTORIES];
+  };
+
+  // everything Undo() needs to take back a Step() or Play()
+  struct UndoRecord {
+    uint64_t hash;
+    Move move;
+    Holder holder;       ///< source of the move before taking tiles
+    Board::LLine line;   ///< pattern line before the move
+    uint8_t floorline;   ///< floorline before the move
+    uint8_t returned;    ///< tiles the move returned to the bag
+    int8_t first;
+    uint8_t turn;
+    uint8_t prev_turn;
+    bool round_over;
+    // only valid when the move ended the round
+    Bag bag;             ///< bag before the round transition and refill
+    Board::RoundUndo rounds[kPlayers];
+  };
+
+  StateT();
+  // legal moves as a set of move ids, see MoveMask
+  MoveMask LegalMask() const;
+  // drops the pattern line moves of legal that cost strictly more floor
+  // penalty than another pattern line taking the same tiles. A heuristic to
+  // narrow the search, not a proof: a dropped move leaves other pattern lines
+  // and walls behind and may be the best one. FLOORLINE dumps are kept.
+  MoveMask PruneFloorOverflow(MoveMask legal) const;
+  // legal moves ordered by move id
   int LegalMoves(MoveList &moves);
   Result Winner();
   int Turn() { return turn_; }
-  void MakePlanes(float *planes);
+  // encodes the network input planes (Size::kPlanes x 5 x 5) of this state
+  void MakePlanes(float *planes) const;
+  // encodes num states into a single NCHW batch
+  static void MakePlanes(const StateT *states, int num, float *planes);
+  // same for packed states, see Pack()
+  static void MakePlanes(const Record *records, int num, float *planes);
   void Reset();
-  void Step(const Move move);
+  // Reset() with the first refill drawn from rng
+  void Reset(utils::Xoshiro256 &rng);
+  // Play() followed by a random refill when the round ended
+  UndoRecord Step(const Move move);
+  // same with the refill drawn from rng, a game is reproduced by its moves
+  // and the seed of rng, see Replay
+  UndoRecord Step(const Move move, utils::Xoshiro256 &rng);
+  // deterministic part of Step(), a move that ends the round scores it and
+  // leaves the factories empty, see IsChance()
+  UndoRecord Play(const Move move);
+  // the factories wait for ApplyChance()
+  bool IsChance() const;
+  // random refill drawn from the bag, the state is left untouched
+  Chance SampleChance() const;
+  Chance SampleChance(utils::Xoshiro256 &rng) const;
+  // fills the factories and takes the tiles from the bag
+  void ApplyChance(const Chance &chance);
+  // restores the state exactly to before the Step() or Play() that returned
+  // record, an applied chance is taken back as well
+  void Undo(const UndoRecord &record);
   void FromString(const std::string center);
-  State &operator=(const State &s);
+  // the packed record as a string
   std::string Serialize() const;
+  void Deserialize(const std::string &bytes);
+  // packed state: holders, bag, turn, lines, walls, floor lines, scores and
+  // the first tile in kRecordSize bytes
+  void Pack(uint8_t *record) const;
+  // restores a packed state, the return pile of the bag isn't part of it and
+  // stays empty
+  void Unpack(const uint8_t *record);
+  // +1 if the player that moved last leads, -1 if anyone else leads, 0 for a
+  // shared lead
   int Outcome();
   bool IsTerminal();
+  // no round follows the current one, the rest of the game is deterministic
+  bool IsFinalRound() const;
+  // full zobrist recompute, Step() keeps hash_ up to date incrementally
+  uint64_t ComputeHash() const;
+  // copy of the state with the factories sorted by content, map is filled
+  // with the move translation
+  StateT Canonical(FactoryMap *map) const;
 
  private:
+  // NOTE: The state holds no pointers or references, so it can be copied with
+  // a single memcpy. Keep it that way, it's copied on every search step.
+  uint64_t hash_{0};
+  std::array<Board, kPlayers> boards_;
   Bag bag_;
   Center center_;
-  std::array<Board, 2> boards_;
   uint8_t turn_{0};
   uint8_t prev_turn_{0};
-  void SetPlane(float *plane, float v);
+  void EncodePlanes(float *planes) const;
+  // Unpack() without the hash
+  void Read(const uint8_t *record);
+  // a state with empty boards and center, nothing drawn from the bag
+  struct Blank {};
+  explicit StateT(Blank) {
+    for (int p = 0; p < kPlayers; p++) boards_[p] = Board(p);
+  }
+  // player that moves after player
+  static int Next(int player) {
+    return player + 1 == kPlayers ? 0 : player + 1;
+  }
 };
 
+using State = StateT<2>;
+
+static_assert(std::is_trivially_copyable<State>::value,
+              "State must be trivially copyable");
+static_assert(sizeof(State) <= 128, "State should fit in two cache lines");
+
+// leaves of the game tree below state up to depth plies, every round end is
+// refilled from a seed derived from seed and the state alone so counts don't
+// depend on the traversal order. Leaves the thread generator alone.
+uint64_t Perft(State &state, int depth, uint64_t seed);
+
 namespace std {
-template <>
-struct hash<State> {
-  std::size_t operator()(const State &state) const {
-    return std::hash<std::string>()(state.Serialize());
+template <int kPlayers>
+struct hash<StateT<kPlayers>> {
+  std::size_t operator()(const StateT<kPlayers> &state) const {
+    return state.hash_;
   }
 };
 }  // namespace std
\ No newline at end of file
@@ -9,11 +9,11 @@ class BoardTest : public testing::Test {
  protected:
   Bag bag_;
   Board *board_;
+  uint64_t hash_{0};
 
   void SetUp() {
-    InitScoreTable();
     bag_.Reset();
-    board_ = new Board(bag_);
+    board_ = new Board();
   }
 
   void TearDown() { delete board_; }
@@ -22,17 +22,17 @@ class BoardTest : public testing::Test {
 TEST_F(BoardTest, Score1) {
   EXPECT_EQ(board_->Score(), 0);
   Move m(Position::FAC1, Tile::BLUE, Line::LINE3);
-  board_->ApplyMove(m, 3);
-  board_->NextRound();
+  board_->ApplyMove(m, 3, bag_, hash_);
+  board_->NextRound(bag_, hash_);
   EXPECT_EQ(board_->Score(), 1);
 }
 
 TEST_F(BoardTest, ScoreTileBonus) {
   for (int i = 0; i < 5; i++) {
     Move m(Position::FAC1, Tile::WHITE, Line(i));
-    board_->ApplyMove(m, i + 1);
+    board_->ApplyMove(m, i + 1, bag_, hash_);
   }
-  board_->NextRound();
+  board_->NextRound(bag_, hash_);
   EXPECT_EQ(board_->Score(), 15);
 }
 
@@ -40,9 +40,9 @@ TEST_F(BoardTest, ScoreColumnBonus) {
   Tile order[] = {BLUE, WHITE, BLACK, RED, YELLOW};
   for (int i = 0; i < 5; i++) {
     Move m(Position::FAC1, order[i], Line(i));
-    board_->ApplyMove(m, i + 1);
+    board_->ApplyMove(m, i + 1, bag_, hash_);
   }
-  board_->NextRound();
+  board_->NextRound(bag_, hash_);
   EXPECT_EQ(board_->Score(), 22);
 }
 
@@ -50,8 +50,8 @@ TEST_F(BoardTest, ScoreRowBonus) {
   int scores[] = {1, 3, 6, 10, 17};
   for (int i = 0; i < 5; i++) {
     Move m(Position::FAC1, Tile(i), LINE2);
-    board_->ApplyMove(m, 2);
-    board_->NextRound();
+    board_->ApplyMove(m, 2, bag_, hash_);
+    board_->NextRound(bag_, hash_);
     EXPECT_EQ(board_->Score(), scores[i]);
   }
 
@@ -66,3 +66,32 @@ TEST_F(BoardTest, WallHasTile) {
   EXPECT_FALSE(board_->WallHasTile(BLUE, LINE1));
   EXPECT_FALSE(board_->WallHasTile(BLUE, LINE5));
 }
+
+TEST_F(BoardTest, Hash) {
+  for (int i = 0; i < 5; i++) {
+    Move m(Position::FAC1, Tile(i), Line(i));
+    board_->ApplyMove(m, i + 2, bag_, hash_);
+    EXPECT_EQ(board_->Hash(), hash_);
+  }
+  board_->IncreaseFloorline(hash_);
+  EXPECT_EQ(board_->Hash(), hash_);
+  board_->NextRound(bag_, hash_);
+  EXPECT_EQ(board_->Hash(), hash_);
+}
+
+TEST(ScoreTest, Tables) { EXPECT_EQ(CheckScoreTables(), 0); }
+
+TEST(ScoreTest, DefaultPath) { EXPECT_EQ(GetScorePath(), ScorePath::kMagic); }
+
+TEST(ScoreTest, Paths) {
+  ScorePath path = GetScorePath();
+  EXPECT_TRUE(SetScorePath(ScorePath::kMagic));
+  EXPECT_EQ(GetScorePath(), ScorePath::kMagic);
+  EXPECT_EQ(GetScore(12, 0), 1);
+  EXPECT_EQ(GetScore(12, Board::kRows[2] | Board::kColumns[2]), 10);
+  if (SetScorePath(ScorePath::kPext)) {
+    EXPECT_EQ(GetScore(12, 0), 1);
+    EXPECT_EQ(GetScore(12, Board::kRows[2] | Board::kColumns[2]), 10);
+  }
+  SetScorePath(path);
+}
@@ -3,12 +3,15 @@
 
 #include "azul/center.h"
 #include "azul/constants.h"
+#include "utils/random.h"
 
 TEST(BagTest, Pop) {
   Bag bag;
+  uint64_t hash = bag.Hash();
   for (int n = 0; n < 3; n++) {
     for (int i = 0; i < Bag::BAG_SIZE; i++) {
-      bag.Pop();
+      bag.Pop(hash);
+      EXPECT_EQ(hash, bag.Hash());
       int sum = 0;
       for (int j = 0; j < Tile::NUM_TILES; j++) {
         sum += bag.tiles[j];
@@ -16,9 +19,66 @@ TEST(BagTest, Pop) {
       EXPECT_EQ(sum, Bag::BAG_SIZE - i - 1);
     }
     bag.Reset();
+    hash = bag.Hash();
   }
 }
 
+TEST(BagTest, Draw) {
+  Bag bag;
+  uint64_t hash = bag.Hash();
+  uint8_t drawn[NUM_TILES] = {};
+  int total = 0;
+
+  // runs out of tiles on the 26th draw, the returned ones refill the bag
+  for (int n = 0; n < 30; n++) {
+    if (n == 20) {
+      for (int j = 0; j < NUM_TILES; j++) {
+        bag.Return(Tile(j), drawn[j]);
+        drawn[j] = 0;
+      }
+    }
+    int num = bag.Draw(Bag::MAX_DRAW, drawn, hash);
+    EXPECT_EQ(num, Bag::MAX_DRAW);
+    EXPECT_EQ(hash, bag.Hash());
+    total += num;
+  }
+
+  int sum = 0;
+  for (int j = 0; j < NUM_TILES; j++) sum += bag.tiles[j] + drawn[j];
+  EXPECT_EQ(sum, Bag::BAG_SIZE);
+  EXPECT_EQ(total, 30 * Bag::MAX_DRAW);
+}
+
+TEST(BagTest, DrawDistribution) {
+  static constexpr int kDraws = 200000;
+  int none = 0, single = 0;
+  for (int n = 0; n < kDraws; n++) {
+    Bag bag;
+    uint64_t hash = 0;
+    uint8_t counts[NUM_TILES] = {};
+    bag.Draw(Bag::MAX_DRAW, counts, hash);
+    none += counts[Tile::BLUE] == 0;
+    for (int j = 0; j < NUM_TILES; j++) single += counts[j] == 4;
+  }
+
+  // C(80, 4) / C(100, 4) and 5 * C(20, 4) / C(100, 4)
+  EXPECT_NEAR(none / double(kDraws), 0.403334, 0.005);
+  EXPECT_NEAR(single / double(kDraws), 0.006178, 0.001);
+}
+
+TEST(BagTest, Seed) {
+  uint8_t a[NUM_TILES] = {}, b[NUM_TILES] = {};
+  uint64_t hash = 0;
+  Bag x, y;
+
+  utils::Random::Get().Seed(42);
+  for (int n = 0; n < 10; n++) x.Draw(Bag::MAX_DRAW, a, hash);
+  utils::Random::Get().Seed(42);
+  for (int n = 0; n < 10; n++) y.Draw(Bag::MAX_DRAW, b, hash);
+
+  for (int j = 0; j < NUM_TILES; j++) EXPECT_EQ(a[j], b[j]);
+}
+
 TEST(HolderTest, Add) {
   Holder h;
   EXPECT_EQ(h.Add(Tile::BLUE, 3), 3);
@@ -79,10 +139,13 @@ TEST(CenterTest, TakeTiles) {
   Bag b;
   Center c(b);
   c.CenterFromString("00_12_3344001111__2201231334_______");
-  EXPECT_EQ(2, c.TakeTiles(Position::FAC1, Tile::BLUE));
+  uint64_t hash = c.Hash();
+  EXPECT_EQ(2, c.TakeTiles(Position::FAC1, Tile::BLUE, hash));
   EXPECT_EQ(9, c.Count(Position::CENTER));
-  EXPECT_EQ(3, c.TakeTiles(Position::CENTER, Tile::BLACK));
+  EXPECT_EQ(hash, c.Hash());
+  EXPECT_EQ(3, c.TakeTiles(Position::CENTER, Tile::BLACK, hash));
   EXPECT_EQ(6, c.Count(Position::CENTER));
+  EXPECT_EQ(hash, c.Hash());
 }
 
 TEST(CenterTest, IsRoundOver) {
@@ -93,6 +156,7 @@ TEST(CenterTest, IsRoundOver) {
   EXPECT_TRUE(c.IsRoundOver());
   c.CenterFromString("____________________111____________");
   EXPECT_FALSE(c.IsRoundOver());
-  c.TakeTiles(Position::CENTER, Tile::YELLOW);
+  uint64_t hash = c.Hash();
+  c.TakeTiles(Position::CENTER, Tile::YELLOW, hash);
   EXPECT_TRUE(c.IsRoundOver());
 }
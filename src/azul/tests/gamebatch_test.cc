@@ -0,0 +1,112 @@
+#include "azul/gamebatch.h"
+
+#include <gtest/gtest.h>
+#include <utils/random.h>
+
+#include <cstring>
+#include <numeric>
+
+#include "azul/constants.h"
+#include "azul/state.h"
+
+class GameBatchTest : public testing::Test {
+ protected:
+  static constexpr int kSize = 61;
+  GameBatch batch_{kSize};
+  std::vector<State> states_{kSize};
+  std::vector<MoveMask> masks_{kSize};
+
+  void SetUp() {
+    for (int l = 0; l < kSize; l++) batch_.Set(l, states_[l]);
+  }
+
+  // picks a random legal move for every lane
+  std::vector<uint8_t> RandomMoves() {
+    std::vector<uint8_t> moves(kSize);
+    batch_.LegalMasks(masks_.data());
+    for (int l = 0; l < kSize; l++) {
+      std::vector<uint8_t> ids;
+      for (uint8_t id : masks_[l]) ids.push_back(id);
+      moves[l] = ids[utils::Random::Get().GetInt(0, ids.size() - 1)];
+    }
+    return moves;
+  }
+
+  // restarts terminal games
+  void ResetTerminal() {
+    for (int l = 0; l < kSize; l++) {
+      if (!batch_.IsTerminal(l)) continue;
+      states_[l].Reset();
+      batch_.Set(l, states_[l]);
+    }
+  }
+};
+
+TEST_F(GameBatchTest, SetGet) {
+  for (int l = 0; l < kSize; l++) {
+    State s = batch_.Get(l);
+    EXPECT_EQ(s.Serialize(), states_[l].Serialize());
+    EXPECT_EQ(std::hash<State>()(s), std::hash<State>()(states_[l]));
+  }
+}
+
+TEST_F(GameBatchTest, LegalMasks) {
+  for (int k = 0; k < 1000; k++) {
+    auto moves = RandomMoves();
+    for (int l = 0; l < kSize; l++) {
+      MoveMask expected = states_[l].LegalMask();
+      ASSERT_EQ(memcmp(&masks_[l], &expected, sizeof(MoveMask)), 0);
+    }
+    batch_.Step(moves.data());
+    for (int l = 0; l < kSize; l++) states_[l] = batch_.Get(l);
+    ResetTerminal();
+  }
+}
+
+TEST_F(GameBatchTest, Step) {
+  int rounds = 0;
+  for (int k = 0; k < 1000; k++) {
+    auto moves = RandomMoves();
+    batch_.Step(moves.data());
+
+    for (int l = 0; l < kSize; l++) {
+      State &s = states_[l];
+      s.Step(Move(moves[l]));
+      State b = batch_.Get(l);
+      std::string expected = s.Serialize(), result = b.Serialize();
+      auto sum = [](const std::string &str, int begin, int end) {
+        return std::accumulate(str.begin() + begin, str.begin() + end, 0);
+      };
+
+      // full factories only occur right after a refill
+      if (sum(expected, 0, 25) == 20) {
+        // refills are random, so only the boards and tile count are equal
+        EXPECT_EQ(result.substr(35), expected.substr(35));
+        EXPECT_EQ(sum(result, 0, 35), sum(expected, 0, 35));
+        s = b;
+        rounds++;
+      } else {
+        ASSERT_EQ(result, expected);
+        ASSERT_EQ(std::hash<State>()(b), std::hash<State>()(s));
+      }
+    }
+    ResetTerminal();
+  }
+  EXPECT_GT(rounds, 0);
+}
+
+TEST_F(GameBatchTest, MakePlanes) {
+  static constexpr int kPlanes = kNumPlanes * 25;
+  std::vector<float> planes(kSize * kPlanes, -1.0f), expected(kSize * kPlanes);
+
+  for (int k = 0; k < 100; k++) {
+    batch_.MakePlanes(planes.data());
+    for (int l = 0; l < kSize; l++) states_[l] = batch_.Get(l);
+    State::MakePlanes(states_.data(), kSize, expected.data());
+    ASSERT_EQ(memcmp(planes.data(), expected.data(), planes.size() * 4), 0);
+
+    auto moves = RandomMoves();
+    batch_.Step(moves.data());
+    ResetTerminal();
+  }
+}
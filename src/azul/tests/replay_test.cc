@@ -0,0 +1,169 @@
+#include "azul/replay.h"
+
+#include <gtest/gtest.h>
+#include <utils/random.h>
+
+#include <sstream>
+#include <vector>
+
+#include "azul/state.h"
+
+// random game recorded as a replay, states and policies are kept for
+// comparison, states ends with the terminal state
+static Replay PlayGame(uint64_t seed, std::vector<State> &states,
+                       std::vector<Replay::Policy> &policies) {
+  Replay replay(seed);
+  utils::Xoshiro256 rng = replay.Rng();
+  State state;
+  state.Reset(rng);
+  MoveList moves;
+  while (!state.IsTerminal()) {
+    int n = state.LegalMoves(moves);
+    // spread the policy over a few moves like a search would
+    Replay::Policy pi{};
+    float sum = 0.0f;
+    for (int i = 0; i < n; i += 3) sum += pi[moves[i].Id()] = i + 1;
+    for (auto &p : pi) p /= sum;
+
+    states.push_back(state);
+    policies.push_back(pi);
+    Move move = moves[utils::Random::Get().GetInt(0, n - 1)];
+    replay.Add(move, pi);
+    state.Step(move, rng);
+  }
+  replay.SetResult(state.Winner());
+  states.push_back(state);
+  return replay;
+}
+
+TEST(ReplayTest, Expand) {
+  utils::Random::Get().Seed(1);
+  for (uint64_t seed = 1; seed <= 20; seed++) {
+    std::vector<State> states;
+    std::vector<Replay::Policy> policies;
+    Replay replay = PlayGame(seed, states, policies);
+
+    std::stringstream ss;
+    replay.Write(ss);
+    Replay read;
+    ASSERT_TRUE(read.Read(ss));
+    EXPECT_FALSE(read.Read(ss));
+
+    std::vector<Replay::Datapoint> records;
+    ASSERT_TRUE(read.Expand(&records));
+    ASSERT_EQ(records.size() + 1, states.size());
+    State::Result result = states.back().Winner();
+    for (size_t i = 0; i < records.size(); i++) {
+      EXPECT_EQ(records[i].state.Serialize(), states[i].Serialize());
+      EXPECT_EQ(records[i].state.ComputeHash(), states[i].ComputeHash());
+      for (int a = 0; a < kNumMoves; a++) {
+        EXPECT_NEAR(records[i].pi[a], policies[i][a], 1e-4f);
+      }
+      int z = result == State::DRAW ? 0
+              : states[i].Turn() + 1 == result ? 1 : -1;
+      EXPECT_EQ(records[i].z, z);
+    }
+  }
+}
+
+TEST(ReplayTest, Size) {
+  std::vector<State> states;
+  std::vector<Replay::Policy> policies;
+  Replay replay = PlayGame(7, states, policies);
+
+  std::stringstream replay_ss, records_ss;
+  replay.Write(replay_ss);
+  std::vector<Replay::Datapoint> records;
+  ASSERT_TRUE(replay.Expand(&records));
+  Replay::WriteRecords(records, records_ss);
+  const size_t record_size = State::kRecordSize + sizeof(Replay::Policy) + 1;
+  EXPECT_EQ(records_ss.str().size(), policies.size() * record_size);
+  EXPECT_LT(replay_ss.str().size() * 10, records_ss.str().size());
+}
+
+TEST(ReplayTest, Truncated) {
+  std::vector<State> states;
+  std::vector<Replay::Policy> policies;
+  std::stringstream ss;
+  PlayGame(3, states, policies).Write(ss);
+  std::string bytes = ss.str();
+
+  std::stringstream truncated(bytes.substr(0, bytes.size() - 1));
+  Replay replay;
+  EXPECT_FALSE(replay.Read(truncated));
+}
+
+TEST(ReplayTest, Corrupt) {
+  // header, seed, result, one ply with a move and n weights
+  auto game = [](uint8_t result, uint8_t move, uint8_t n, uint8_t id,
+                 uint16_t weight, uint16_t version = Replay::kVersion) {
+    std::stringstream ss;
+    const uint32_t magic = Replay::kMagic;
+    const uint64_t seed = 1;
+    const uint16_t plies = 1;
+    ss.write(reinterpret_cast<const char *>(&magic), sizeof(magic));
+    ss.write(reinterpret_cast<const char *>(&version), sizeof(version));
+    ss.write(reinterpret_cast<const char *>(&seed), sizeof(seed));
+    ss.write(reinterpret_cast<const char *>(&result), sizeof(result));
+    ss.write(reinterpret_cast<const char *>(&plies), sizeof(plies));
+    ss.write(reinterpret_cast<const char *>(&move), sizeof(move));
+    ss.write(reinterpret_cast<const char *>(&n), sizeof(n));
+    for (int i = 0; i < n; i++) {
+      ss.write(reinterpret_cast<const char *>(&id), sizeof(id));
+      ss.write(reinterpret_cast<const char *>(&weight), sizeof(weight));
+    }
+    return ss.str();
+  };
+
+  Replay replay;
+  std::stringstream valid(game(State::PLAYER1, 7, 1, 7, 65535));
+  EXPECT_TRUE(replay.Read(valid));
+
+  for (const std::string &bytes :
+       {game(State::PLAYER2 + 1, 7, 1, 7, 65535),
+        game(State::PLAYER1, kNumMoves, 1, 7, 65535),
+        game(State::PLAYER1, 7, 1, kNumMoves, 65535),
+        game(State::PLAYER1, 7, 1, 255, 65535),
+        game(State::PLAYER1, 7, 0, 7, 65535),
+        game(State::PLAYER1, 7, 1, 7, 0),
+        game(State::PLAYER1, 7, 1, 7, 65535, Replay::kVersion + 1),
+        std::string(4, 'x') + game(State::PLAYER1, 7, 1, 7, 65535).substr(4)}) {
+    std::stringstream ss(bytes);
+    EXPECT_FALSE(replay.Read(ss));
+  }
+}
+
+TEST(ReplayTest, ExactPolicies) {
+  std::vector<State> states;
+  std::vector<Replay::Policy> policies;
+  Replay replay = PlayGame(5, states, policies);
+
+  // a game that was recorded, not read, keeps the policies bit for bit
+  std::vector<Replay::Datapoint> records;
+  ASSERT_TRUE(replay.Expand(&records));
+  ASSERT_EQ(records.size(), policies.size());
+  for (size_t i = 0; i < records.size(); i++) {
+    EXPECT_EQ(records[i].pi, policies[i]);
+  }
+}
+
+TEST(ReplayTest, IllegalMove) {
+  std::vector<State> states;
+  std::vector<Replay::Policy> policies;
+  std::stringstream ss;
+  PlayGame(9, states, policies).Write(ss);
+  std::string bytes = ss.str();
+
+  // the first move, after the header, seed, result and ply count, becomes
+  // one that the first state doesn't allow
+  MoveMask legal = states[0].LegalMask();
+  int illegal = 0;
+  while (legal.Test(illegal)) illegal++;
+  bytes[4 + 2 + 8 + 1 + 2] = illegal;
+  std::stringstream corrupt(bytes);
+  Replay replay;
+  ASSERT_TRUE(replay.Read(corrupt));
+  std::vector<Replay::Datapoint> records;
+  EXPECT_FALSE(replay.Expand(&records));
+  EXPECT_TRUE(records.empty());
+}
@@ -0,0 +1,95 @@
+#include "azul/solver.h"
+
+#include <gtest/gtest.h>
+#include <utils/random.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "azul/state.h"
+
+// Plain minimax without pruning or transpositions, used as reference for
+// Solver::Solve()
+static int ReferenceValue(State &state) {
+  MoveList moves;
+  int n = state.LegalMoves(moves), best = -1;
+  for (int i = 0; i < n && best < 1; i++) {
+    auto record = state.Step(moves[i]);
+    int v = state.IsTerminal() ? state.Outcome() : -ReferenceValue(state);
+    state.Undo(record);
+    best = std::max(best, v);
+  }
+  return best;
+}
+
+// random final round positions with at most max_moves legal moves
+static std::vector<State> FinalRounds(int num, int max_moves) {
+  std::vector<State> states;
+  State state;
+  MoveList moves;
+  while (int(states.size()) < num) {
+    if (state.IsTerminal()) state.Reset();
+    int n = state.LegalMoves(moves);
+    if (state.IsFinalRound() && n <= max_moves) states.push_back(state);
+    state.Step(moves[utils::Random::Get().GetInt(0, n - 1)]);
+  }
+  return states;
+}
+
+TEST(SolverTest, FinalRound) {
+  State state;
+  EXPECT_FALSE(state.IsFinalRound());
+  int value;
+  Solver solver;
+  EXPECT_FALSE(solver.Solve(state, &value));
+}
+
+TEST(SolverTest, Reference) {
+  utils::Random::Get().Seed(11);
+  Solver solver;
+
+  for (State &state : FinalRounds(200, 12)) {
+    const std::string before = state.Serialize();
+    int value;
+    Move best;
+    ASSERT_TRUE(solver.Solve(state, &value, &best, 1 << 30));
+    EXPECT_EQ(state.Serialize(), before);
+    EXPECT_EQ(value, ReferenceValue(state));
+
+    // the returned move reaches the value
+    MoveMask legal = state.LegalMask();
+    ASSERT_TRUE(legal.Test(best.Id()));
+    state.Step(best);
+    int v = state.IsTerminal() ? state.Outcome() : -ReferenceValue(state);
+    EXPECT_EQ(v, value);
+  }
+}
+
+TEST(SolverTest, Budget) {
+  utils::Random::Get().Seed(12);
+  State state = FinalRounds(1, 40)[0];
+
+  int value, exact;
+  Solver solver;
+  EXPECT_FALSE(solver.Solve(state, &value, nullptr, 10));
+  EXPECT_GT(solver.Nodes(), 10);
+
+  ASSERT_TRUE(solver.Solve(state, &exact, nullptr, 1 << 30));
+  // a second search starts from the table
+  ASSERT_TRUE(solver.Solve(state, &value));
+  EXPECT_EQ(value, exact);
+  EXPECT_EQ(solver.Nodes(), 1);
+}
+
+TEST(SolverTest, Replacement) {
+  utils::Random::Get().Seed(13);
+  // far more states than table entries go through one solver
+  Solver solver;
+  for (State &state : FinalRounds(20, 40)) {
+    int value, fresh;
+    ASSERT_TRUE(solver.Solve(state, &value, nullptr, 1 << 30));
+    Solver other;
+    ASSERT_TRUE(other.Solve(state, &fresh, nullptr, 1 << 30));
+    EXPECT_EQ(value, fresh);
+  }
+}
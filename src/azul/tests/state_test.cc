@@ -3,16 +3,101 @@
 #include <gtest/gtest.h>
 #include <utils/random.h>
 
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
 #include "azul/board.h"
 #include "azul/center.h"
 #include "azul/constants.h"
-#include "azul/magics.h"
+
+// Straightforward move generator working on the serialized state, used as
+// reference for State::LegalMask()
+static int ReferenceLegalMoves(const State &state, MoveList &moves) {
+  const std::string s = state.Serialize();
+  const uint8_t *holders = reinterpret_cast<const uint8_t *>(&s[0]);
+  const int turn = s[35];
+  const uint8_t *left = reinterpret_cast<const uint8_t *>(&s[36 + turn * 10]);
+  uint32_t wall;
+  memcpy(&wall, &s[56 + turn * 4], sizeof(wall));
+
+  int i = 0;
+  for (int pos = 0; pos < NUM_POS; pos++) {
+    for (int tile = 0; tile < NUM_TILES; tile++) {
+      if (holders[pos * NUM_TILES + tile] == 0) continue;
+      for (int line = 0; line < NUM_LINES - 1; line++) {
+        int type = left[line * 2], count = left[line * 2 + 1];
+        int col = (line + tile) % Board::SIZE;
+        if (count < line + 1 && (count == 0 || type == tile) &&
+            !(wall & (1u << (line * Board::SIZE + col)))) {
+          moves[i++] = Move(Position(pos), Tile(tile), Line(line));
+        }
+      }
+      moves[i++] = Move(Position(pos), Tile(tile), FLOORLINE);
+    }
+  }
+  return i;
+}
+
+// Plane encoding of the serialized state following training/generator.py, used
+// as reference for State::MakePlanes()
+static std::vector<float> ReferencePlanes(const State &state) {
+  const std::string s = state.Serialize();
+  const uint8_t *c = reinterpret_cast<const uint8_t *>(&s[0]);
+  const uint8_t *b = reinterpret_cast<const uint8_t *>(&s[30]);
+  const int t = s[35];
+  const uint8_t *l1 = reinterpret_cast<const uint8_t *>(&s[36 + t * 10]);
+  const uint8_t *l2 = reinterpret_cast<const uint8_t *>(&s[46 - t * 10]);
+  uint32_t w1, w2;
+  memcpy(&w1, &s[56 + t * 4], sizeof(w1));
+  memcpy(&w2, &s[60 - t * 4], sizeof(w2));
+  const int f1 = uint8_t(s[64 + t]), f2 = uint8_t(s[65 - t]);
+  const int s1 = uint8_t(s[66 + t]), s2 = uint8_t(s[67 - t]);
+  const int first = int8_t(s[68]);
+
+  std::vector<float> planes(kNumPlanes * 25, 0.0f);
+  auto fill = [&](int index, float v) {
+    for (int i = 0; i < 25; i++) planes[index * 25 + i] = v;
+  };
+
+  int index = 0;
+  fill(index++, s1 / 255.0f);
+  fill(index++, s2 / 255.0f);
+  for (int i = 0; i < NUM_TILES; i++) fill(index++, b[i] / 20.0f);
+  for (int i = 0; i < NUM_POS; i++) {
+    int empty = i == CENTER ? 15 : 4;
+    for (int tile = 0; tile < NUM_TILES; tile++) {
+      for (int n = 0; n < c[i * NUM_TILES + tile]; n++, empty--) {
+        fill(index++, (tile + 1) / 5.0f);
+      }
+    }
+    index += empty;
+  }
+  fill(index++, (first + 1) / 2.0f);
+
+  const uint8_t *left[] = {l1, l2};
+  const uint32_t wall[] = {w1, w2};
+  const int floor[] = {f1, f2};
+  for (int p = 0; p < 2; p++) {
+    for (int i = 0; i < 5; i++) {
+      for (int j = 0; j < left[p][i * 2 + 1]; j++) {
+        planes[index * 25 + i * 5 + j] = (left[p][i * 2] + 1) / 5.0f;
+      }
+    }
+    index++;
+    for (int i = 0; i < 25; i++) {
+      planes[index * 25 + i] = (wall[p] >> (24 - i)) & 1;
+    }
+    index++;
+    fill(index++, floor[p] / 7.0f);
+  }
+
+  return planes;
+}
 
 class StateTest : public testing::Test {
  protected:
   State state_;
-
-  void SetUp() { InitScoreTable(); }
 };
 
 TEST_F(StateTest, LegalMoves1) {
@@ -53,6 +138,129 @@ TEST_F(StateTest, LegalMoves2) {
   EXPECT_EQ(n, 5);
 }
 
+TEST_F(StateTest, PruneFloorOverflow) {
+  state_.FromString("____001____________________________");
+  MoveMask pruned = state_.PruneFloorOverflow(state_.LegalMask());
+  EXPECT_EQ(pruned.Count(), 11);
+
+  // two blue tiles overflow line 1 only, dumps to the floor line are kept
+  EXPECT_FALSE(pruned.Test(Move(FAC2, BLUE, LINE1).Id()));
+  EXPECT_TRUE(pruned.Test(Move(FAC2, BLUE, FLOORLINE).Id()));
+  EXPECT_TRUE(pruned.Test(Move(FAC2, YELLOW, FLOORLINE).Id()));
+  for (Line line : {LINE2, LINE3, LINE4, LINE5}) {
+    EXPECT_TRUE(pruned.Test(Move(FAC2, BLUE, line).Id()));
+  }
+}
+
+TEST_F(StateTest, PruneFloorOverflowGames) {
+  MoveList moves;
+  for (int k = 0; k < 20000; k++) {
+    if (state_.IsTerminal()) state_.Reset();
+    MoveMask legal = state_.LegalMask();
+    MoveMask pruned = state_.PruneFloorOverflow(legal);
+
+    // a subset that keeps a placement for every source and tile and every
+    // floor line dump
+    uint64_t groups = 0, kept = 0;
+    for (int id : legal) groups |= 1ull << (id / NUM_LINES);
+    for (int id : pruned) {
+      ASSERT_TRUE(legal.Test(id));
+      kept |= 1ull << (id / NUM_LINES);
+    }
+    ASSERT_EQ(groups, kept);
+    for (int id : legal) {
+      if (id % NUM_LINES == FLOORLINE) {
+        ASSERT_TRUE(pruned.Test(id));
+      }
+    }
+
+    int n = state_.LegalMoves(moves);
+    state_.Step(moves[utils::Random::Get().GetInt(0, n - 1)]);
+  }
+}
+
+TEST_F(StateTest, Perft) {
+  // counts of azul_perft perft 4, update them only for intended rule changes
+  const std::pair<const char *, std::vector<uint64_t>> kCounts[] = {
+      {"01234012340123401234_______________", {120, 13680, 1197720}},
+      {"________2221________44444__________", {18, 216, 1116, 92647}},
+  };
+  for (const auto &[position, counts] : kCounts) {
+    for (size_t d = 0; d < counts.size(); d++) {
+      utils::Random::Get().Seed(1);
+      state_.FromString(position);
+      EXPECT_EQ(Perft(state_, d + 1, 1), counts[d]) << position << " " << d;
+    }
+  }
+
+  // refills come from a generator of their own
+  state_.FromString(kCounts[1].first);
+  utils::Xoshiro256 before = utils::Random::Get().Fast();
+  Perft(state_, 4, 1);
+  EXPECT_EQ(utils::Random::Get().Fast()(), before());
+}
+
+TEST_F(StateTest, Deserialize) {
+  MoveList moves;
+  State state;
+  for (int k = 0; k < 10000; k++) {
+    if (state_.IsTerminal()) state_.Reset();
+    const std::string bytes = state_.Serialize();
+    state.Deserialize(bytes);
+    ASSERT_EQ(state.Serialize(), bytes);
+    ASSERT_EQ(std::hash<State>()(state), std::hash<State>()(state_));
+    ASSERT_EQ(state.LegalMask().Count(), state_.LegalMask().Count());
+
+    int n = state_.LegalMoves(moves);
+    state_.Step(moves[utils::Random::Get().GetInt(0, n - 1)]);
+  }
+}
+
+TEST_F(StateTest, MoveId) {
+  for (int id = 0; id < kNumMoves; id++) {
+    Move move(id);
+    EXPECT_EQ(move.Id(), id);
+    EXPECT_EQ(std::hash<Move>()(move), id);
+  }
+}
+
+TEST_F(StateTest, MoveMask) {
+  MoveMask mask;
+  mask.Clear();
+  std::vector<int> ids = {0, 29, 30, 59, 60, 63, 64, 119, 120, 179};
+  for (int id : ids) mask.Set(id);
+  EXPECT_EQ(mask.Count(), int(ids.size()));
+
+  std::vector<int> result;
+  for (uint8_t id : mask) result.push_back(id);
+  EXPECT_EQ(result, ids);
+
+  for (int id = 0; id < kNumMoves; id++) {
+    bool expected = std::find(ids.begin(), ids.end(), id) != ids.end();
+    EXPECT_EQ(mask.Test(id), expected);
+  }
+
+  mask.Clear();
+  EXPECT_FALSE(mask.begin() != mask.end());
+}
+
+TEST_F(StateTest, LegalMovesDifferential) {
+  static constexpr int kPositions = 1 << 20;
+  MoveList moves, expected;
+
+  for (int i = 0; i < kPositions; i++) {
+    if (state_.IsTerminal()) state_.Reset();
+    int n = state_.LegalMoves(moves);
+    int m = ReferenceLegalMoves(state_, expected);
+    ASSERT_EQ(n, m) << "position " << i;
+    ASSERT_EQ(state_.LegalMask().Count(), n);
+    for (int j = 0; j < n; j++) {
+      ASSERT_EQ(moves[j].Id(), expected[j].Id()) << "position " << i;
+    }
+    state_.Step(moves[utils::Random::Get().GetInt(0, n - 1)]);
+  }
+}
+
 TEST_F(StateTest, SimulateGame) {
   MoveList moves;
   int n;
@@ -81,6 +289,110 @@ TEST_F(StateTest, Assignment) {
   }
 }
 
+TEST_F(StateTest, Hash) {
+  MoveList moves;
+  for (int i = 0; i < 100; i++) {
+    state_.Reset();
+    EXPECT_EQ(std::hash<State>()(state_), state_.ComputeHash());
+    while (!state_.IsTerminal()) {
+      int n = state_.LegalMoves(moves);
+      state_.Step(moves[utils::Random::Get().GetInt(0, n - 1)]);
+      EXPECT_EQ(std::hash<State>()(state_), state_.ComputeHash());
+    }
+  }
+}
+
+TEST_F(StateTest, HashTransposition) {
+  state_.FromString("0000111122223333444401234__________");
+  State s2 = state_;
+
+  state_.Step(Move(FAC1, BLUE, LINE4));
+  state_.Step(Move(FAC2, YELLOW, LINE4));
+  state_.Step(Move(FAC3, RED, LINE5));
+
+  s2.Step(Move(FAC3, RED, LINE5));
+  s2.Step(Move(FAC2, YELLOW, LINE4));
+  s2.Step(Move(FAC1, BLUE, LINE4));
+
+  EXPECT_EQ(s2.Serialize(), state_.Serialize());
+  EXPECT_EQ(std::hash<State>()(s2), std::hash<State>()(state_));
+}
+
+// State is trivially copyable, so a bytewise comparison covers all members
+template <int kPlayers>
+static bool Identical(const StateT<kPlayers> &a, const StateT<kPlayers> &b) {
+  return memcmp(&a, &b, sizeof(StateT<kPlayers>)) == 0;
+}
+
+TEST_F(StateTest, UndoGame) {
+  MoveList moves;
+  for (int k = 0; k < 100; k++) {
+    std::vector<State> states;
+    std::vector<State::UndoRecord> records;
+    state_.Reset();
+    while (!state_.IsTerminal()) {
+      int n = state_.LegalMoves(moves);
+      n = utils::Random::Get().GetInt(0, n - 1);
+      states.push_back(state_);
+      records.push_back(state_.Step(moves[n]));
+    }
+
+    while (!records.empty()) {
+      state_.Undo(records.back());
+      ASSERT_TRUE(Identical(state_, states.back()));
+      ASSERT_EQ(std::hash<State>()(state_), state_.ComputeHash());
+      records.pop_back();
+      states.pop_back();
+    }
+  }
+}
+
+TEST_F(StateTest, UndoAllMoves) {
+  MoveList moves;
+  for (int k = 0; k < 10000; k++) {
+    if (state_.IsTerminal()) state_.Reset();
+    State copy = state_;
+    int n = state_.LegalMoves(moves);
+    for (int i = 0; i < n; i++) {
+      auto record = state_.Step(moves[i]);
+      state_.Undo(record);
+      ASSERT_TRUE(Identical(state_, copy));
+    }
+    state_.Step(moves[utils::Random::Get().GetInt(0, n - 1)]);
+  }
+}
+
+TEST_F(StateTest, Chance) {
+  MoveList moves;
+  int rounds = 0;
+  for (int k = 0; k < 20000; k++) {
+    if (state_.IsTerminal()) state_.Reset();
+    ASSERT_FALSE(state_.IsChance());
+    int n = state_.LegalMoves(moves);
+    Move move = moves[utils::Random::Get().GetInt(0, n - 1)];
+
+    // Play() and a sampled chance draw the same refill as Step()
+    State step = state_, copy = state_;
+    utils::Random::Get().Seed(k + 1);
+    step.Step(move);
+    utils::Random::Get().Seed(k + 1);
+    auto record = state_.Play(move);
+    ASSERT_EQ(state_.IsChance(), record.round_over);
+    if (record.round_over) {
+      ASSERT_EQ(std::hash<State>()(state_), state_.ComputeHash());
+      state_.ApplyChance(state_.SampleChance());
+      rounds++;
+    }
+    ASSERT_TRUE(Identical(state_, step));
+    ASSERT_EQ(std::hash<State>()(state_), state_.ComputeHash());
+
+    state_.Undo(record);
+    ASSERT_TRUE(Identical(state_, copy));
+    state_ = step;
+  }
+  EXPECT_GT(rounds, 1000);
+}
+
 TEST_F(StateTest, MakePlanes) {
   state_.FromString("________2221________44444__________");
 
@@ -94,4 +406,109 @@ TEST_F(StateTest, MakePlanes) {
 
   std::vector<float> planes(49*5*5);
   state_.MakePlanes(planes.data());
+  auto expected = ReferencePlanes(state_);
+  EXPECT_EQ(memcmp(planes.data(), expected.data(), planes.size() * 4), 0);
+}
+
+TEST_F(StateTest, MakePlanesBatch) {
+  static constexpr int kBatchSize = 64;
+  static constexpr int kPlanes = kNumPlanes * 25;
+  std::vector<State> states(kBatchSize);
+  // poison the buffer, every plane must be written
+  std::vector<float> planes(kBatchSize * kPlanes, -1.0f);
+  MoveList moves;
+
+  for (int k = 0; k < 100; k++) {
+    for (auto &s : states) {
+      if (s.IsTerminal()) s.Reset();
+      int n = s.LegalMoves(moves);
+      s.Step(moves[utils::Random::Get().GetInt(0, n - 1)]);
+    }
+
+    State::MakePlanes(states.data(), kBatchSize, planes.data());
+    for (int i = 0; i < kBatchSize; i++) {
+      auto expected = ReferencePlanes(states[i]);
+      ASSERT_EQ(memcmp(&planes[i * kPlanes], expected.data(), kPlanes * 4), 0);
+    }
+
+    // packed states expand to the same planes
+    std::vector<float> packed(kBatchSize * kPlanes, -1.0f);
+    std::vector<State::Record> records(kBatchSize);
+    for (int i = 0; i < kBatchSize; i++) states[i].Pack(records[i].data());
+    State::MakePlanes(records.data(), kBatchSize, packed.data());
+    ASSERT_EQ(packed, planes);
+  }
+}
+
+TEST_F(StateTest, Canonical) {
+  // same factories in a different order
+  // the bag is drawn randomly on Reset(), keep it equal
+  State a, b;
+  utils::Random::Get().Seed(7);
+  a.FromString("0011222200141133____01234__________");
+  utils::Random::Get().Seed(7);
+  b.FromString("1133____00110014222201234__________");
+  EXPECT_NE(std::hash<State>()(a), std::hash<State>()(b));
+
+  FactoryMap ma, mb;
+  State ca = a.Canonical(&ma), cb = b.Canonical(&mb);
+  EXPECT_EQ(ca.Serialize(), cb.Serialize());
+  EXPECT_EQ(std::hash<State>()(ca), std::hash<State>()(cb));
+  EXPECT_EQ(std::hash<State>()(ca), ca.ComputeHash());
+  EXPECT_EQ(a.Canonical(&ma).Serialize(), ca.Canonical(&ma).Serialize());
+
+  // moves translate both ways and stay legal
+  for (uint8_t id : a.LegalMask()) {
+    uint8_t c = ma.ToCanonical(id);
+    EXPECT_EQ(ma.FromCanonical(c), id);
+    EXPECT_TRUE(ca.LegalMask().Test(c));
+    EXPECT_EQ(ma.FromCanonical(Move(c)).Id(), id);
+
+    State sa = a, sc = ca;
+    sa.Step(Move(id));
+    sc.Step(Move(c));
+    FactoryMap m1, m2;
+    EXPECT_EQ(sa.Canonical(&m1).Serialize(), sc.Canonical(&m2).Serialize());
+  }
+}
+
+// plays random games with more players, every move is undone once to check
+// that it restores the state exactly
+template <int kPlayers>
+static void RandomGames(int games) {
+  using S = StateT<kPlayers>;
+  using Size = GameSize<kPlayers>;
+  std::vector<float> planes(Size::kPlanes * 25);
+  typename S::MoveList moves;
+
+  for (int k = 0; k < games; k++) {
+    S state;
+    std::string str = state.Serialize();
+    int tiles = std::accumulate(str.begin(), str.begin() + 5 * Size::kCenter,
+                                0);
+    ASSERT_EQ(tiles, 4 * Size::kFactories);
+
+    while (!state.IsTerminal()) {
+      int n = state.LegalMoves(moves);
+      ASSERT_GT(n, 0);
+      ASSERT_LT(moves[n - 1].Id(), Size::kMoves);
+      Move move = moves[utils::Random::Get().GetInt(0, n - 1)];
+
+      S copy = state;
+      auto record = state.Step(move);
+      ASSERT_EQ(std::hash<S>()(state), state.ComputeHash());
+      state.Undo(record);
+      ASSERT_TRUE(Identical(state, copy));
+
+      state.Step(move);
+      state.MakePlanes(planes.data());
+    }
+    size_t size = 5 * Size::kPositions + 7 + 16 * kPlayers;
+    EXPECT_EQ(state.Serialize().size(), size);
+    EXPECT_LE(state.Winner(), kPlayers);
+  }
 }
+
+TEST_F(StateTest, ThreePlayers) { RandomGames<3>(200); }
+
+TEST_F(StateTest, FourPlayers) { RandomGames<4>(200); }
@@ -0,0 +1,76 @@
+#include <stdio.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "replay.h"
+
+// usage: azul_unpack <output dir> <game.azr>...
+//
+// expands self-play replays into the per-ply record files read by the
+// training scripts, <name>.azr becomes <output dir>/<name>.bin. A replay file
+// may hold several games back to back. A file that fails to parse leaves no
+// .bin behind, the records go to a temporary file that is renamed once all
+// games of the file are expanded.
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s <output dir> <game.azr>...\n", argv[0]);
+    return 1;
+  }
+
+  const std::string dir = argv[1];
+  size_t games = 0, records = 0;
+  for (int i = 2; i < argc; i++) {
+    std::ifstream in(argv[i], std::ios::binary);
+    if (!in) {
+      fprintf(stderr, "can't open %s\n", argv[i]);
+      return 1;
+    }
+
+    std::string name = argv[i];
+    name = name.substr(name.find_last_of('/') + 1);
+    name = name.substr(0, name.rfind(".azr")) + ".bin";
+    const std::string path = dir + "/" + name;
+    const std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary);
+    if (!out) {
+      fprintf(stderr, "can't write %s\n", tmp.c_str());
+      return 1;
+    }
+
+    // the end of the file has to fall on the end of a game
+    Replay replay;
+    std::vector<Replay::Datapoint> expanded;
+    const char *error = nullptr;
+    size_t game = 0;
+    for (; in.peek() != std::char_traits<char>::eof(); game++) {
+      if (!replay.Read(in)) {
+        error = "truncated, corrupt or of another version";
+        break;
+      }
+      if (!replay.Expand(&expanded)) {
+        error = "illegal move";
+        break;
+      }
+      Replay::WriteRecords(expanded, out);
+      records += expanded.size();
+    }
+    out.close();
+    if (!error && !out) error = "write failed";
+    if (error) {
+      fprintf(stderr, "%s: game %zu: %s\n", argv[i], game, error);
+      remove(tmp.c_str());
+      return 1;
+    }
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+      fprintf(stderr, "can't rename %s\n", tmp.c_str());
+      return 1;
+    }
+    games += game;
+  }
+
+  printf("%zu games, %zu records\n", games, records);
+  return 0;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "constants.h"
+
+// Zobrist keys for incremental state hashing. Every counter in the state has a
+// key per (location, value) pair, the key for an empty location is always 0 so
+// empty parts of the state don't contribute to the hash.
+namespace zobrist {
+
+/* maximum tiles of a single color, bounds holder and bag counts */
+static constexpr int kMaxCount = 20;
+/* side of the wall */
+static constexpr int kSize = 5;
+/* floorline can't hold more than the tiles of a round and the first tile,
+ * 4 per factory */
+static constexpr int kMaxFloorline = 4 * GameSize<kMaxPlayers>::kFactories + 1;
+/* scores are stored in a single byte */
+static constexpr int kMaxScore = 256;
+
+// sized for the largest player count, smaller games use a prefix
+struct Keys {
+  uint64_t holder[kMaxPositions][NUM_TILES][kMaxCount + 1];
+  uint64_t bag[NUM_TILES][kMaxCount + 1];
+  uint64_t left[kMaxPlayers][kSize][NUM_TILES][kSize + 1];
+  uint64_t wall[kMaxPlayers][kSize * kSize];
+  uint64_t floorline[kMaxPlayers][kMaxFloorline + 1];
+  uint64_t score[kMaxPlayers][kMaxScore];
+  uint64_t first[kMaxPlayers + 1];
+  uint64_t turn[kMaxPlayers];
+};
+
+// splitmix64, good enough to generate independent keys at compile time
+constexpr uint64_t Next(uint64_t &x) {
+  uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+// floorline keys past it were added last, the keys before them and the
+// refills of Perft() that depend on them stay as they were
+static constexpr int kOldFloorline = 32;
+
+constexpr Keys Generate() {
+  Keys k{};
+  uint64_t x = 0x61306120617a756cull;
+
+  for (int p = 0; p < kMaxPositions; p++)
+    for (int t = 0; t < NUM_TILES; t++)
+      for (int n = 1; n <= kMaxCount; n++) k.holder[p][t][n] = Next(x);
+
+  for (int t = 0; t < NUM_TILES; t++)
+    for (int n = 1; n <= kMaxCount; n++) k.bag[t][n] = Next(x);
+
+  for (int p = 0; p < kMaxPlayers; p++) {
+    for (int l = 0; l < kSize; l++)
+      for (int t = 0; t < NUM_TILES; t++)
+        for (int n = 1; n <= kSize; n++) k.left[p][l][t][n] = Next(x);
+    for (int i = 0; i < kSize * kSize; i++) k.wall[p][i] = Next(x);
+    for (int i = 1; i < kOldFloorline; i++) k.floorline[p][i] = Next(x);
+    for (int i = 1; i < kMaxScore; i++) k.score[p][i] = Next(x);
+  }
+
+  for (int i = 1; i <= kMaxPlayers; i++) k.first[i] = Next(x);
+  for (int i = 1; i < kMaxPlayers; i++) k.turn[i] = Next(x);
+  for (int p = 0; p < kMaxPlayers; p++)
+    for (int i = kOldFloorline; i <= kMaxFloorline; i++)
+      k.floorline[p][i] = Next(x);
+  return k;
+}
+
+inline constexpr Keys kKeys = Generate();
+
+inline uint64_t Holder(int pos, int tile, int count) {
+  return kKeys.holder[pos][tile][count];
+}
+
+inline uint64_t Bag(int tile, int count) { return kKeys.bag[tile][count]; }
+
+inline uint64_t Left(int player, int line, int tile, int count) {
+  return kKeys.left[player][line][tile][count];
+}
+
+inline uint64_t Wall(int player, int square) {
+  return kKeys.wall[player][square];
+}
+
+inline uint64_t Floorline(int player, int n) {
+  return kKeys.floorline[player][n];
+}
+
+inline uint64_t Score(int player, int score) {
+  return kKeys.score[player][score];
+}
+
+// first tile belongs to -1 (none) or a player
+inline uint64_t First(int first) { return kKeys.first[first + 1]; }
+
+// player 0 to move has no key
+inline uint64_t Turn(int turn) { return kKeys.turn[turn]; }
+
+}  // namespace zobrist
@@ -0,0 +1,579 @@
+#include <benchmark/benchmark.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <coroutine>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "azul/board.h"
+#include "azul/center.h"
+#include "azul/gamebatch.h"
+#include "azul/magics.h"
+#include "azul/state.h"
+#include "mcts/mcts.h"
+#include "mcts/nncache.h"
+#include "mcts/ttable.h"
+#include "neural/neuralnet.h"
+#include "utils/random.h"
+#include "utils/task.h"
+#include "version.h"
+
+// Micro benchmarks of the hot functions of the game core and search.
+//
+// usage: benchmarks [--fixtures=<self-play file>] [benchmark flags]
+//
+// Positions are read from a self-play file when given, otherwise they come
+// from seeded random games. Use --benchmark_format=json or
+// --benchmark_out=<file> to compare runs across commits and hosts.
+
+static constexpr int kFixtures = 256;
+// serialized state, policy and outcome of a self-play datapoint
+static constexpr int kStateSize = 69;
+static constexpr int kDatapointSize = kStateSize + kNumMoves * 4 + 1;
+
+static std::string fixtures_file;
+
+static std::vector<State> LoadFixtures() {
+  std::vector<State> states;
+  if (!fixtures_file.empty()) {
+    std::ifstream file(fixtures_file, std::ios::binary);
+    std::string datapoint(kDatapointSize, '\0');
+    while (file.read(&datapoint[0], kDatapointSize)) {
+      states.emplace_back();
+      states.back().Deserialize(datapoint.substr(0, kStateSize));
+    }
+    if (!states.empty()) return states;
+  }
+
+  utils::Random::Get().Seed(1);
+  State state;
+  MoveList moves;
+  while (states.size() < kFixtures) {
+    if (state.IsTerminal()) state.Reset();
+    states.push_back(state);
+    int n = state.LegalMoves(moves);
+    state.Step(moves[utils::Random::Get().GetBounded(n)]);
+  }
+  return states;
+}
+
+static const std::vector<State> &Fixtures() {
+  static const std::vector<State> states = LoadFixtures();
+  return states;
+}
+
+// fixtures before the final round, where the tree rather than the final round
+// solver takes the time of a search
+static const std::vector<State> &MidgameFixtures() {
+  static const std::vector<State> states = [] {
+    std::vector<State> result;
+    for (const State &state : Fixtures()) {
+      if (!state.IsFinalRound()) result.push_back(state);
+    }
+    return result;
+  }();
+  return states;
+}
+
+// gives up the slots of the network batch the searches don't take, as
+// main.cc does
+static void UseSlots(NeuralNet &net, int slots) {
+  net.DecreaseBatchSize(net.MaxBatchSize() - slots);
+}
+
+// a legal move for every fixture
+static const std::vector<Move> &FixtureMoves() {
+  static const std::vector<Move> moves = [] {
+    std::vector<Move> result;
+    MoveList list;
+    for (State state : Fixtures()) {
+      int n = state.LegalMoves(list);
+      result.push_back(list[n / 2]);
+    }
+    return result;
+  }();
+  return moves;
+}
+
+static void BM_Step(benchmark::State &bench) {
+  const auto &states = Fixtures();
+  const auto &moves = FixtureMoves();
+  size_t i = 0;
+  for (auto _ : bench) {
+    State state = states[i];
+    state.Step(moves[i]);
+    benchmark::DoNotOptimize(state);
+    if (++i == states.size()) i = 0;
+  }
+}
+BENCHMARK(BM_Step);
+
+static void BM_StepUndo(benchmark::State &bench) {
+  std::vector<State> states = Fixtures();
+  const auto &moves = FixtureMoves();
+  size_t i = 0;
+  for (auto _ : bench) {
+    auto record = states[i].Step(moves[i]);
+    benchmark::DoNotOptimize(states[i]);
+    states[i].Undo(record);
+    if (++i == states.size()) i = 0;
+  }
+}
+BENCHMARK(BM_StepUndo);
+
+static void BM_LegalMoves(benchmark::State &bench) {
+  std::vector<State> states = Fixtures();
+  MoveList moves;
+  size_t i = 0;
+  for (auto _ : bench) {
+    benchmark::DoNotOptimize(states[i].LegalMoves(moves));
+    benchmark::ClobberMemory();
+    if (++i == states.size()) i = 0;
+  }
+}
+BENCHMARK(BM_LegalMoves);
+
+static void BM_LegalMask(benchmark::State &bench) {
+  const auto &states = Fixtures();
+  size_t i = 0;
+  for (auto _ : bench) {
+    benchmark::DoNotOptimize(states[i].LegalMask());
+    if (++i == states.size()) i = 0;
+  }
+}
+BENCHMARK(BM_LegalMask);
+
+static void BM_MakePlanes(benchmark::State &bench) {
+  const auto &states = Fixtures();
+  std::vector<float> planes(kNumPlanes * 5 * 5);
+  size_t i = 0;
+  for (auto _ : bench) {
+    states[i].MakePlanes(planes.data());
+    benchmark::ClobberMemory();
+    if (++i == states.size()) i = 0;
+  }
+}
+BENCHMARK(BM_MakePlanes);
+
+// a batch of packed states as expanded by the network before inference
+static void BM_MakePlanesPacked(benchmark::State &bench) {
+  const auto &states = Fixtures();
+  std::vector<State::Record> records(states.size());
+  for (size_t i = 0; i < states.size(); i++) states[i].Pack(records[i].data());
+  std::vector<float> planes(records.size() * kNumPlanes * 5 * 5);
+  for (auto _ : bench) {
+    State::MakePlanes(records.data(), records.size(), planes.data());
+    benchmark::ClobberMemory();
+  }
+  bench.SetItemsProcessed(bench.iterations() * records.size());
+}
+BENCHMARK(BM_MakePlanesPacked);
+
+static void BM_Pack(benchmark::State &bench) {
+  const auto &states = Fixtures();
+  State::Record record;
+  size_t i = 0;
+  for (auto _ : bench) {
+    states[i].Pack(record.data());
+    benchmark::DoNotOptimize(record);
+    if (++i == states.size()) i = 0;
+  }
+}
+BENCHMARK(BM_Pack);
+
+// the k-th legal move of mask, k taken from r
+static uint8_t PickMove(const MoveMask &mask, uint64_t r) {
+  int k = r % mask.Count();
+  for (int id : mask) {
+    if (k-- == 0) return id;
+  }
+  return 0;
+}
+
+// many random games stepped one after the other, the argument is the number
+// of games. Compare with BM_GameBatchStep.
+static void BM_StepGames(benchmark::State &bench) {
+  utils::Random::Get().Seed(1);
+  utils::Xoshiro256 rng(1);
+  std::vector<State> states(bench.range(0));
+  for (auto _ : bench) {
+    for (State &state : states) {
+      state.Step(Move(PickMove(state.LegalMask(), rng())));
+      if (state.IsTerminal()) state.Reset();
+    }
+    benchmark::ClobberMemory();
+  }
+  bench.SetItemsProcessed(bench.iterations() * states.size());
+}
+BENCHMARK(BM_StepGames)->Arg(256);
+
+// the same games stepped in lockstep by a GameBatch
+static void BM_GameBatchStep(benchmark::State &bench) {
+  utils::Random::Get().Seed(1);
+  utils::Xoshiro256 rng(1);
+  const int size = bench.range(0);
+  GameBatch batch(size);
+  std::vector<MoveMask> masks(size);
+  std::vector<uint8_t> moves(size);
+  for (auto _ : bench) {
+    batch.LegalMasks(masks.data());
+    for (int l = 0; l < size; l++) moves[l] = PickMove(masks[l], rng());
+    batch.Step(moves.data());
+    for (int l = 0; l < size; l++) {
+      if (batch.IsTerminal(l)) batch.Set(l, State());
+    }
+    benchmark::ClobberMemory();
+  }
+  bench.SetItemsProcessed(bench.iterations() * size);
+}
+BENCHMARK(BM_GameBatchStep)->Arg(256);
+
+// network input of a batch of games, compare with BM_MakePlanesPacked
+static void BM_GameBatchPlanes(benchmark::State &bench) {
+  const auto &states = Fixtures();
+  GameBatch batch(states.size());
+  for (size_t l = 0; l < states.size(); l++) batch.Set(l, states[l]);
+  std::vector<float> planes(states.size() * kNumPlanes * 5 * 5);
+  for (auto _ : bench) {
+    batch.MakePlanes(planes.data());
+    benchmark::ClobberMemory();
+  }
+  bench.SetItemsProcessed(bench.iterations() * states.size());
+}
+BENCHMARK(BM_GameBatchPlanes);
+
+static void BM_Serialize(benchmark::State &bench) {
+  const auto &states = Fixtures();
+  size_t i = 0;
+  for (auto _ : bench) {
+    benchmark::DoNotOptimize(states[i].Serialize());
+    if (++i == states.size()) i = 0;
+  }
+}
+BENCHMARK(BM_Serialize);
+
+static void BM_Hash(benchmark::State &bench) {
+  const auto &states = Fixtures();
+  size_t i = 0;
+  for (auto _ : bench) {
+    benchmark::DoNotOptimize(std::hash<State>()(states[i]));
+    if (++i == states.size()) i = 0;
+  }
+}
+BENCHMARK(BM_Hash);
+
+static void BM_ComputeHash(benchmark::State &bench) {
+  const auto &states = Fixtures();
+  size_t i = 0;
+  for (auto _ : bench) {
+    benchmark::DoNotOptimize(states[i].ComputeHash());
+    if (++i == states.size()) i = 0;
+  }
+}
+BENCHMARK(BM_ComputeHash);
+
+// random walls and every pattern line that still fits a tile full, so
+// NextRound() scores up to five placements
+static std::vector<Board> RandomBoards() {
+  auto &random = utils::Random::Get();
+  random.Seed(1);
+
+  std::vector<Board> boards(4096);
+  for (auto &board : boards) {
+    board.wall = random.GetBounded(1u << 25) & random.GetBounded(1u << 25);
+    for (int row = 0; row < Board::SIZE; row++) {
+      int tile = random.GetBounded(NUM_TILES);
+      if (board.WallHasTile(Tile(tile), Line(row))) continue;
+      board.left[row] = {uint8_t(tile), uint8_t(row + 1)};
+    }
+  }
+  return boards;
+}
+
+// Arg(0) is the magic multiply path, Arg(1) the pext path
+static bool SelectScorePath(benchmark::State &bench) {
+  if (SetScorePath(ScorePath(bench.range(0)))) return true;
+  bench.SkipWithError("score path unsupported on this cpu");
+  return false;
+}
+
+// restores the score path picked at startup
+struct ScorePathGuard {
+  ~ScorePathGuard() { SetScorePath(path); }
+  ScorePath path = GetScorePath();
+};
+
+static void BM_GetScore(benchmark::State &bench) {
+  ScorePathGuard guard;
+  if (!SelectScorePath(bench)) return;
+  auto boards = RandomBoards();
+  size_t i = 0;
+  for (auto _ : bench) {
+    const Board &board = boards[i];
+    benchmark::DoNotOptimize(GetScore(i % 25, board.wall | 1u << (i % 25)));
+    if (++i == boards.size()) i = 0;
+  }
+}
+BENCHMARK(BM_GetScore)->Arg(0)->Arg(1);
+
+static void BM_NextRound(benchmark::State &bench) {
+  ScorePathGuard guard;
+  if (!SelectScorePath(bench)) return;
+  auto boards = RandomBoards();
+  Bag bag;
+  uint64_t hash = 0;
+  size_t i = 0;
+  for (auto _ : bench) {
+    Board board = boards[i];
+    board.NextRound(bag, hash);
+    benchmark::DoNotOptimize(board);
+    if (++i == boards.size()) {
+      i = 0;
+      bag.Reset();
+    }
+  }
+}
+BENCHMARK(BM_NextRound)->Arg(0)->Arg(1);
+
+static void BM_BagPop(benchmark::State &bench) {
+  utils::Random::Get().Seed(1);
+  Bag bag;
+  uint64_t hash = 0;
+  int n = 0;
+  for (auto _ : bench) {
+    benchmark::DoNotOptimize(bag.Pop(hash));
+    if (++n == Bag::BAG_SIZE) {
+      n = 0;
+      bag.Reset();
+    }
+  }
+}
+BENCHMARK(BM_BagPop);
+
+static void BM_BagDraw(benchmark::State &bench) {
+  utils::Random::Get().Seed(1);
+  Bag bag;
+  uint64_t hash = 0;
+  int n = 0;
+  for (auto _ : bench) {
+    uint8_t counts[NUM_TILES] = {};
+    benchmark::DoNotOptimize(bag.Draw(Bag::MAX_DRAW, counts, hash));
+    if (++n == Bag::BAG_SIZE / Bag::MAX_DRAW) {
+      n = 0;
+      bag.Reset();
+    }
+  }
+}
+BENCHMARK(BM_BagDraw);
+
+// a full search from an empty tree against a network that answers instantly
+static void BM_GetPolicy(benchmark::State &bench) {
+  const auto &states = Fixtures();
+  NeuralNet net;
+  UseSlots(net, 1);
+  MCTS mcts(net);
+  Move best;
+  size_t i = 0;
+  utils::Random::Get().Seed(1);
+  for (auto _ : bench) {
+    State state = states[i];
+    benchmark::DoNotOptimize(mcts.GetPolicy(state, best, 1e-5f, true));
+    bench.PauseTiming();
+    mcts.Clear();
+    if (++i == states.size()) i = 0;
+    bench.ResumeTiming();
+  }
+}
+BENCHMARK(BM_GetPolicy)->Unit(benchmark::kMillisecond);
+
+// same for the midgame fixtures. The argument is the size of a transposition
+// table in MB, 0 searches without one.
+static void BM_GetPolicyMidgame(benchmark::State &bench) {
+  const auto &states = MidgameFixtures();
+  NeuralNet net;
+  UseSlots(net, 1);
+  std::unique_ptr<TranspositionTable> tt;
+  if (bench.range(0)) tt = std::make_unique<TranspositionTable>(bench.range(0));
+  MCTS mcts(net, false, false, tt.get());
+  Move best;
+  size_t i = 0;
+  utils::Random::Get().Seed(1);
+  for (auto _ : bench) {
+    State state = states[i];
+    benchmark::DoNotOptimize(mcts.GetPolicy(state, best, 1e-5f, true));
+    bench.PauseTiming();
+    mcts.Clear();
+    if (++i == states.size()) i = 0;
+    bench.ResumeTiming();
+  }
+}
+BENCHMARK(BM_GetPolicyMidgame)
+    ->Arg(0)
+    ->Arg(64)
+    ->Unit(benchmark::kMillisecond);
+
+// one search of a midgame position by 1 to 32 threads sharing the tree
+static void BM_ParallelSearch(benchmark::State &bench) {
+  const State &position = MidgameFixtures().back();
+  NeuralNet net;
+  UseSlots(net, bench.range(0));
+  MCTS mcts(net, false, false, nullptr, bench.range(0));
+  Move best;
+  utils::Random::Get().Seed(1);
+  for (auto _ : bench) {
+    State state = position;
+    benchmark::DoNotOptimize(mcts.GetPolicy(state, best, 1e-5f, true));
+    bench.PauseTiming();
+    mcts.Clear();
+    bench.ResumeTiming();
+  }
+}
+BENCHMARK(BM_ParallelSearch)
+    ->RangeMultiplier(2)
+    ->Range(1, 32)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// the same search by one thread that gathers 1 to 32 leaves per request
+static void BM_BatchedSearch(benchmark::State &bench) {
+  const State &position = MidgameFixtures().back();
+  NeuralNet net;
+  UseSlots(net, bench.range(0));
+  MCTS mcts(net, false, false, nullptr, 1, bench.range(0));
+  Move best;
+  utils::Random::Get().Seed(1);
+  for (auto _ : bench) {
+    State state = position;
+    benchmark::DoNotOptimize(mcts.GetPolicy(state, best, 1e-5f, true));
+    bench.PauseTiming();
+    mcts.Clear();
+    bench.ResumeTiming();
+  }
+}
+BENCHMARK(BM_BatchedSearch)
+    ->RangeMultiplier(2)
+    ->Range(1, 32)
+    ->Unit(benchmark::kMillisecond);
+
+// searches of the midgame positions sharing an evaluation cache of the
+// argument in MB, the first pass over the positions fills it
+static void BM_CachedSearch(benchmark::State &bench) {
+  const auto &states = MidgameFixtures();
+  NeuralNet net;
+  UseSlots(net, 1);
+  NNCache cache(bench.range(0));
+  MCTS mcts(net);
+  mcts.UseCache(&cache);
+  Move best;
+  size_t i = 0;
+  utils::Random::Get().Seed(1);
+  for (auto _ : bench) {
+    State state = states[i];
+    benchmark::DoNotOptimize(mcts.GetPolicy(state, best, 1e-5f, true));
+    bench.PauseTiming();
+    mcts.Clear();
+    if (++i == states.size()) i = 0;
+    bench.ResumeTiming();
+  }
+  bench.counters["hit_rate"] =
+      double(cache.Hits()) / (cache.Hits() + cache.Misses());
+}
+BENCHMARK(BM_CachedSearch)->Arg(64)->Unit(benchmark::kMillisecond);
+
+// midgame searches that stop early once the most visited move is decided,
+// the argument enables it. Reports the simulations saved per search.
+static void BM_EarlyStop(benchmark::State &bench) {
+  const auto &states = MidgameFixtures();
+  NeuralNet net;
+  UseSlots(net, 1);
+  MCTS mcts(net);
+  mcts.StopEarly(bench.range(0));
+  Move best;
+  size_t i = 0;
+  int64_t saved = 0;
+  utils::Random::Get().Seed(1);
+  for (auto _ : bench) {
+    State state = states[i];
+    benchmark::DoNotOptimize(mcts.GetPolicy(state, best, 1e-5f, true));
+    bench.PauseTiming();
+    saved += mcts.SavedSimulations();
+    mcts.Clear();
+    if (++i == states.size()) i = 0;
+    bench.ResumeTiming();
+  }
+  bench.counters["saved"] = double(saved) / bench.iterations();
+}
+BENCHMARK(BM_EarlyStop)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// a search that suspends for every batch of leaves, as in self-play
+static utils::Task SteppedSearch(MCTS &mcts, State state) {
+  Policy pi;
+  Move best;
+  if (!mcts.Start(state, best, pi)) co_return;
+  while (mcts.Gather(1e-5f)) {
+    co_await std::suspend_always{};
+    mcts.Backup();
+  }
+  benchmark::DoNotOptimize(mcts.Finish(best, true));
+}
+
+// 1 to 32 searches of 8 leaves per request multiplexed on one thread, the
+// network evaluates the leaves of all of them at once
+static void BM_MultiplexedSearch(benchmark::State &bench) {
+  const State &position = MidgameFixtures().back();
+  NeuralNet net;
+  UseSlots(net, bench.range(0) * 8);
+  std::vector<std::unique_ptr<MCTS>> searches;
+  for (int i = 0; i < bench.range(0); i++) {
+    searches.push_back(
+        std::make_unique<MCTS>(net, false, false, nullptr, 1, 8));
+  }
+  std::vector<utils::Task> tasks(searches.size());
+  utils::Random::Get().Seed(1);
+  for (auto _ : bench) {
+    for (size_t i = 0; i < searches.size(); i++) {
+      tasks[i] = SteppedSearch(*searches[i], position);
+    }
+    for (bool running = true; running;) {
+      running = false;
+      for (auto &task : tasks) {
+        if (!task.Done()) task.Resume();
+        running |= !task.Done();
+      }
+      net.InputReady(searches.size() * 8);
+    }
+    bench.PauseTiming();
+    for (auto &mcts : searches) mcts->Clear();
+    bench.ResumeTiming();
+  }
+  bench.SetItemsProcessed(bench.iterations() * searches.size());
+}
+BENCHMARK(BM_MultiplexedSearch)
+    ->RangeMultiplier(2)
+    ->Range(1, 32)
+    ->Unit(benchmark::kMillisecond);
+
+int main(int argc, char **argv) {
+  // takes out our own flag before google benchmark sees the rest
+  int n = 1;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--fixtures=", 11) == 0) {
+      fixtures_file = argv[i] + 11;
+    } else {
+      argv[n++] = argv[i];
+    }
+  }
+  argc = n;
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+  benchmark::AddCustomContext("version", VERSION);
+  benchmark::AddCustomContext("fixtures",
+                              fixtures_file.empty() ? "random" : fixtures_file);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,107 @@
+#include <glog/logging.h>
+
+#include <algorithm>
+
+#include "azul/constants.h"
+#include "neural/neuralnet.h"
+#include "neural/nnlogger.h"
+
+// NeuralNet without a gpu for the benchmarks and the search tests. Every
+// evaluation expands the packed states to planes and returns a uniform policy
+// and a value of 0, so MCTS timings exclude inference only. Batches are
+// formed like in neuralnet.cc, a thread waits in InputReady() until all slots
+// of the batch are ready or given up. Callers give up the slots they don't
+// take as main.cc does, the batch counts MaxBatchSize() slots otherwise.
+
+static constexpr int kSlots = 256;
+static constexpr int kPlaneSize = kNumPlanes * 5 * 5;
+
+NeuralNet::NeuralNet()
+    : max_batch_size_(kSlots),
+      batch_size_(0),
+      soft_max_batch_size_(kSlots),
+      buffer_index_(0),
+      generation_(0),
+      forwarding_(false) {
+  logger_ = std::make_unique<Logger>();
+  sizes_[0] = kSlots * kPlaneSize;
+  sizes_[1] = kSlots * kNumMoves;
+  sizes_[2] = kSlots;
+  for (int i = 0; i < kNumBuffers; i++) {
+    gpu_buffers_[i] = nullptr;
+    host_buffers_[i] = new float[sizes_[i]]();
+  }
+  std::fill_n(host_buffers_[1], sizes_[1], 1.0f / kNumMoves);
+  records_.assign(max_batch_size_, State::Record{});
+}
+
+NeuralNet::~NeuralNet() {
+  for (int i = 0; i < kNumBuffers; i++) delete[] host_buffers_[i];
+}
+
+void NeuralNet::Load(const std::string &) {}
+
+NeuralNet::NetBuffer NeuralNet::GetBuffers(int n) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CHECK(buffer_index_ + n <= kSlots) << "Out of network slots";
+  const int slot = buffer_index_;
+  buffer_index_ += n;
+  return std::make_tuple(&records_[slot], &host_buffers_[1][slot * kNumMoves],
+                         &host_buffers_[2][slot]);
+}
+
+void NeuralNet::InputReady(int n) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [&] { return !forwarding_; });
+  batch_size_ += n;
+  const int generation = generation_;
+
+  if (batch_size_ == soft_max_batch_size_) {
+    forwarding_ = true;
+    lock.unlock();
+    Forward();
+    Done();
+  } else {
+    cv_.wait(lock, [&] { return generation_ != generation; });
+  }
+}
+
+void NeuralNet::DecreaseBatchSize(int n) {
+  bool ready = false;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    soft_max_batch_size_ -= n;
+    ready = !forwarding_ && batch_size_ > 0 &&
+            batch_size_ == soft_max_batch_size_;
+    if (ready) forwarding_ = true;
+  }
+
+  if (ready) {
+    Forward();
+    Done();
+  }
+}
+
+void NeuralNet::IncreaseBatchSize(int n) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  // the batch on the gpu reads all slots, the thread writes its own after
+  cv_.wait(lock, [&] { return !forwarding_; });
+  soft_max_batch_size_ += n;
+}
+
+void NeuralNet::Done() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    batch_size_ = 0;
+    generation_++;
+    forwarding_ = false;
+  }
+  cv_.notify_all();
+}
+
+void NeuralNet::Forward() {
+  // all slots handed out like the real network, threads outside of the batch
+  // write theirs only after IncreaseBatchSize()
+  State::MakePlanes(records_.data(), buffer_index_, host_buffers_[0]);
+}
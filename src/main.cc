@@ -1,89 +1,163 @@
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <atomic>
+#include <coroutine>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <thread>
 #include <vector>
 
-#include "azul/magics.h"
+#include "azul/replay.h"
 #include "azul/state.h"
 #include "mcts/mcts.h"
+#include "mcts/nncache.h"
+#include "mcts/ttable.h"
 #include "neural/neuralnet.h"
 #include "utils/random.h"
+#include "utils/task.h"
 #include "version.h"
 
 DEFINE_int32(num_games, 10000, "Nof games to produce");
 DEFINE_string(model, "network.trt.bin", "TensorRT Plan file");
 DEFINE_string(output, ".", "Output directory to store games");
+DEFINE_uint64(seed, 0,
+              "Seed for reproducible games, 0 seeds randomly. Game n follows "
+              "from seed and n, its searches only repeat exactly without "
+              "the shared tt and cache");
+DEFINE_bool(prune, false,
+            "Skip pattern line moves that drop more tiles to the floor than "
+            "another line would, a heuristic that may skip the best move. "
+            "Their policy targets are 0");
+DEFINE_bool(replay, false,
+            "Store games as seed, moves and policies (.azr) instead of the "
+            ".bin records of the training scripts, azul_unpack expands them");
+DEFINE_bool(huge_pages, false, "Back the search trees with 2 MB pages");
+DEFINE_uint64(tree_mb, 64,
+              "Memory cap of every search tree in MB, the least visited "
+              "subtrees are dropped beyond it, 0 for no cap");
+DEFINE_int32(threads, 0,
+             "Threads that play the games, 0 for one per core. The network "
+             "batch is shared by max batch size / search_batch games that are "
+             "spread over the threads");
+DEFINE_int32(search_batch, 1,
+             "Leaves every game gathers per network request");
+DEFINE_uint64(tt_mb, 64,
+              "Size of the transposition table shared by all self-play "
+              "threads in MB, 0 disables it");
+DEFINE_int32(simulations, 800, "Root visits of every search");
+DEFINE_bool(early_stop, false,
+            "Stop a search once the simulations left can't change the move "
+            "played. Its visits are then a truncated policy target");
+DEFINE_double(kl_gain, 0.0,
+              "Also stop once the root visit distribution changes by less "
+              "than this KL divergence per simulation, 0 disables it");
+DEFINE_uint64(cache_mb, 256,
+              "Size of the network evaluation cache shared by all games in "
+              "MB, 0 disables it");
 
 static const char kOutcome[] = {'D', 'W', 'L'};
 
-struct Datapoint {
-  Datapoint(const State &s, const Policy &pi, int z) : s(s), pi(pi), z(z) {}
-  void Serialize(std::ostream &stream) {
-    stream << s.Serialize();
-    stream.write(reinterpret_cast<char *>(pi.data()),
-                 pi.size() * sizeof(pi[0]));
-    stream.write(reinterpret_cast<char *>(&z), sizeof(z));
-    stream.flush();
-  }
-  State s;
-  Policy pi;
-  int8_t z;
-};
-
-std::string SaveGame(std::vector<Datapoint> game, State::Result result,
-                     const int num) {
+std::string SaveGame(const Replay &replay, const int num) {
   thread_local std::string randstr = utils::Random::Get().GetString(8);
   std::stringstream ss;
-  ss << FLAGS_output << "/azul-" << num << "-" << randstr << ".bin";
+  ss << FLAGS_output << "/azul-" << num << "-" << randstr
+     << (FLAGS_replay ? ".azr" : ".bin");
   std::ofstream file(ss.str(), std::iostream::binary);
 
-  for (int i = 0, n = game.size(); i < n; i++) {
-    if (result == State::DRAW) {
-      game[i].z = 0;
-    } else {
-      if ((game[i].s.Turn() + 1) == result) {
-        game[i].z = 1;
-      } else {
-        game[i].z = -1;
-      }
-    }
-
-    game[i].Serialize(file);
+  if (FLAGS_replay) {
+    replay.Write(file);
+  } else {
+    // the moves were legal when they were played
+    std::vector<Replay::Datapoint> records;
+    CHECK(replay.Expand(&records));
+    Replay::WriteRecords(records, file);
   }
 
   file.close();
   return ss.str();
 }
 
-void SelfPlay(int num_games, NeuralNet &net) {
-  MCTS mcts(net);
-  Policy pi;
-  Move abest;
+// one game, suspends whenever its search waits for the network
+utils::Task PlayGame(MCTS &mcts, int num) {
+  // a game follows from --seed and its number alone, whichever thread plays
+  // it. Refills come from a generator of their own such that the game can be
+  // replayed from its seed, the search draws from another one.
+  const uint64_t seed = FLAGS_seed ? utils::SplitMix64(FLAGS_seed ^ num)
+                                   : utils::Random::Get().GetBounded(~0ull);
+  Replay replay(seed);
+  mcts.Seed(utils::SplitMix64(seed));
+  utils::Xoshiro256 rng = replay.Rng();
   State state;
-
-  std::vector<Datapoint> game;
-  for (int i = 0; i < num_games; i++) {
-    game.clear();
-    state.Reset();
-    mcts.Clear();
-    int num_plies = 0;
-
-    while (!state.IsTerminal()) {
-      pi = mcts.GetPolicy(state, abest, 1e-5f, true);
-      game.emplace_back(Datapoint{state, pi, 0});
-      state.Step(abest);
-      num_plies++;
+  state.Reset(rng);
+  mcts.Clear();
+  int num_plies = 0;
+  int saved = 0;
+
+  while (!state.IsTerminal()) {
+    Policy pi;
+    Move abest;
+    if (mcts.Start(state, abest, pi)) {
+      while (mcts.Gather(1e-5f)) {
+        // SelfPlay() evaluates the leaves of all its games at once
+        co_await std::suspend_always{};
+        mcts.Backup();
+      }
+      pi = mcts.Finish(abest, true);
+      saved += mcts.SavedSimulations();
+      VLOG(2) << "[" << num + 1 << "] ply " << num_plies << ": "
+              << mcts.SavedSimulations() << " simulations saved";
     }
+    replay.Add(abest, pi);
+    state.Step(abest, rng);
+    // the subtree below the move played is searched on
+    mcts.Advance(abest, state);
+    num_plies++;
+  }
 
-    auto result = state.Winner();
-    auto filename = SaveGame(game, result, i);
-    VLOG(1) << "[" << i + 1 << "/" << num_games << "] " << filename << " "
-            << num_plies << " " << kOutcome[result];
+  auto result = state.Winner();
+  replay.SetResult(result);
+  auto filename = SaveGame(replay, num);
+  VLOG(1) << "[" << num + 1 << "/" << FLAGS_num_games << "] " << filename
+          << " " << num_plies << " " << kOutcome[result] << " "
+          << saved / num_plies << " simulations saved per move";
+}
+
+// Plays games on one thread until next_game runs out. Every game is a
+// coroutine with a search of its own, they run in turn up to their next
+// network request and the thread sends all their leaves in one batch. A
+// finished game hands its search and slots to the next game right away, so
+// the batch keeps its size until no games are left.
+void SelfPlay(int num_searches, NeuralNet &net, TranspositionTable *tt,
+              NNCache *cache, std::atomic<int> &next_game) {
+  std::vector<std::unique_ptr<MCTS>> searches;
+  for (int i = 0; i < num_searches; i++) {
+    searches.push_back(std::make_unique<MCTS>(
+        net, FLAGS_prune, FLAGS_huge_pages, tt, 1, FLAGS_search_batch));
+    searches.back()->LimitTree(FLAGS_tree_mb << 20);
+    searches.back()->UseCache(cache);
+    searches.back()->SetSimulations(FLAGS_simulations);
+    searches.back()->StopEarly(FLAGS_early_stop, FLAGS_kl_gain);
+  }
+
+  std::vector<utils::Task> games(num_searches);
+  for (;;) {
+    bool running = false;
+    for (int i = 0; i < num_searches; i++) {
+      if (!games[i].Done()) games[i].Resume();
+      int num;
+      while (games[i].Done() && (num = next_game++) < FLAGS_num_games) {
+        games[i] = PlayGame(*searches[i], num);
+        games[i].Resume();
+      }
+      running |= !games[i].Done();
+    }
+    if (!running) break;
+    net.InputReady(num_searches * FLAGS_search_batch);
   }
 
-  net.DecreaseBatchSize();
+  net.DecreaseBatchSize(num_searches * FLAGS_search_batch);
 }
 
 int main(int argc, char **argv) {
@@ -97,17 +171,31 @@ int main(int argc, char **argv) {
   ::google::InitGoogleLogging(argv[0]);
   ::google::InstallFailureSignalHandler();
 
-  InitScoreTable();
-
   NeuralNet net;
   net.Load(FLAGS_model);
-  int num_threads = net.MaxBatchSize();
-  int num_games = FLAGS_num_games / num_threads;
-  int remainder = FLAGS_num_games % num_threads;
+  CHECK(FLAGS_search_batch >= 1 && FLAGS_search_batch <= net.MaxBatchSize())
+      << "--search_batch must be within the batch of the network ("
+      << net.MaxBatchSize() << ")";
+  // every game takes search_batch slots of the batch, unused slots are given
+  // up
+  const int max_searches = std::max(1, net.MaxBatchSize() / FLAGS_search_batch);
+  int num_threads = FLAGS_threads ? FLAGS_threads
+                                  : std::thread::hardware_concurrency();
+  num_threads = std::clamp(num_threads, 1, max_searches);
+  net.DecreaseBatchSize(net.MaxBatchSize() - max_searches * FLAGS_search_batch);
+  int num_searches = max_searches / num_threads;
+  int remainder = max_searches % num_threads;
+  std::atomic<int> next_game{0};
+
+  std::unique_ptr<TranspositionTable> tt;
+  if (FLAGS_tt_mb) tt = std::make_unique<TranspositionTable>(FLAGS_tt_mb);
+  std::unique_ptr<NNCache> cache;
+  if (FLAGS_cache_mb) cache = std::make_unique<NNCache>(FLAGS_cache_mb);
 
   std::vector<std::thread> threads;
   for (int i = 0; i < num_threads; i++) {
-    std::thread t(SelfPlay, num_games + (remainder > 0), std::ref(net));
+    std::thread t(SelfPlay, num_searches + (remainder > 0), std::ref(net),
+                  tt.get(), cache.get(), std::ref(next_game));
     remainder--;
     threads.push_back(std::move(t));
   }
@@ -115,6 +203,10 @@ int main(int argc, char **argv) {
   for (int i = 0; i < num_threads; i++) {
     threads[i].join();
   }
+  if (cache) {
+    VLOG(1) << "Evaluation cache: " << cache->Hits() << " hits, "
+            << cache->Misses() << " misses";
+  }
 
   ::google::ShutDownCommandLineFlags();
   ::google::ShutdownGoogleLogging();
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+// fp16 conversion of the priors in NNCache, rounded to nearest with ties to
+// even. The portable versions stand in for F16C and are built everywhere,
+// so they can be tested against it. Values are never negative, infinite or
+// nan, values beyond the range of fp16 saturate.
+
+// bits >> shift rounded to nearest, ties to even
+inline uint16_t RoundShift(uint32_t bits, int shift) {
+  const uint32_t half = 1u << (shift - 1);
+  const uint32_t rest = bits & ((half << 1) - 1);
+  const uint32_t r = bits >> shift;
+  return r + (rest > half || (rest == half && (r & 1)));
+}
+
+inline uint16_t ToHalfPortable(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  const int exp = int((x >> 23) & 0xff) - 127 + 15;
+  uint32_t mant = x & 0x7fffff;
+  if (exp >= 31) return 0x7bff;
+  if (exp <= 0) {
+    // subnormal, the implicit bit is shifted in
+    if (exp < -10) return 0;
+    return RoundShift(mant | 0x800000, 14 - exp);
+  }
+  // a carry of the rounding moves on to the exponent
+  return RoundShift(uint32_t(exp) << 23 | mant, 13);
+}
+
+inline float FromHalfPortable(uint16_t h) {
+  int exp = (h >> 10) & 0x1f;
+  uint32_t mant = h & 0x3ff;
+  if (exp == 0) {
+    if (mant == 0) return 0.0f;
+    // subnormal, normalized for the wider exponent
+    exp = 1;
+    while (!(mant & 0x400)) {
+      mant <<= 1;
+      exp--;
+    }
+    mant &= 0x3ff;
+  }
+  const uint32_t x = uint32_t(exp + 127 - 15) << 23 | mant << 13;
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+inline uint16_t ToHalf(float f) {
+#if defined(__F16C__)
+  return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+  return ToHalfPortable(f);
+#endif
+}
+
+inline float FromHalf(uint16_t h) {
+#if defined(__F16C__)
+  return _cvtsh_ss(h);
+#else
+  return FromHalfPortable(h);
+#endif
+}
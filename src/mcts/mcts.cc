@@ -2,128 +2,688 @@
 
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <cmath>
 #include <limits>
+#include <random>
 
 #include "azul/state.h"
 #include "utils/random.h"
 #include "neural/neuralnet.h"
 
-static const int kReserves = 1 << 17;
+MCTS::MCTS(NeuralNet &net, bool prune, bool huge_pages,
+           TranspositionTable *tt, int threads, int batch)
+    : arena_(huge_pages),
+      spare_(huge_pages),
+      nn_(net),
+      prune_(prune),
+      batch_(batch),
+      tt_(tt) {
+  // the slots of all threads have to fit in one network batch
+  CHECK(threads >= 1 && batch >= 1);
+  CHECK_LE(threads * batch, nn_.MaxBatchSize()) << "Too many search slots";
+  for (int i = 0; i < threads; i++) {
+    workers_.push_back(std::make_unique<Worker>());
+    Worker &worker = *workers_.back();
+    std::tie(worker.record, worker.policy, worker.v) = nn_.GetBuffers(batch_);
+  }
+  Seed(utils::Random::Get().GetBounded(~0ull));
+  // the other threads join the network batch for the searches only
+  nn_.DecreaseBatchSize((threads - 1) * batch_);
+  for (int i = 1; i < threads; i++) {
+    threads_.emplace_back(&MCTS::WorkerLoop, this, i);
+  }
+}
+
+MCTS::~MCTS() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_cv_.notify_all();
+  for (auto &thread : threads_) thread.join();
+}
+
+void MCTS::WorkerLoop(int id) {
+  Worker &worker = *workers_[id];
+  int generation = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_cv_.wait(lock, [&] { return stop_ || generation_ != generation; });
+      if (stop_) return;
+      generation = generation_;
+    }
+
+    nn_.IncreaseBatchSize(batch_);
+    State state = root_state_;
+    Simulate(worker, state, search_temp_);
+    nn_.DecreaseBatchSize(batch_);
 
-MCTS::MCTS(NeuralNet &net): nn_(net) {
-  std::tie(planes_, policy_, v_) = nn_.GetBuffers();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--running_ == 0) done_cv_.notify_all();
+  }
+}
+
+void MCTS::Simulate(Worker &worker, State &state, float temp) {
+  if (batch_ > 1) return SimulateBatch(worker, state, temp);
+  float v;
+  while (!over_limit_.load(std::memory_order_relaxed)) {
+    if (!Claim()) break;
+    if (!Search(worker, state, root_, 0, temp, &v)) {
+      // collided with an expansion, the simulation is tried again once it
+      // is done
+      claimed_.fetch_sub(1, std::memory_order_relaxed);
+      WaitFor(worker.pending);
+    }
+  }
+}
+
+void MCTS::WaitFor(const Node *node) {
+  // the batch of the expanding thread must not wait for this one
+  nn_.DecreaseBatchSize(batch_);
+  node->WaitExpanded();
+  nn_.IncreaseBatchSize(batch_);
+}
+
+void MCTS::SimulateBatch(Worker &worker, const State &state, float temp) {
+  while (GatherBatch(worker, state, temp)) {
+    // one request for all leaves, unused slots are evaluated in vain
+    if (worker.slots) nn_.InputReady(batch_);
+    BackupBatch(worker);
+    // without leaves the thread waits on expansions of the others
+    if (!worker.slots && worker.pending) WaitFor(worker.pending);
+  }
+}
+
+bool MCTS::GatherBatch(Worker &worker, const State &state, float temp) {
+  worker.NewBatch();
+  if (over_limit_.load(std::memory_order_relaxed)) return false;
+  // a collision keeps its virtual loss until the batch is done, so the next
+  // descents avoid the pending leaf
+  int collisions = 0;
+  while (worker.slots < batch_ && collisions < batch_) {
+    if (!Claim()) break;
+    Descend(worker, state, temp);
+    if (worker.descents.back().leaf == Descent::kCollided) {
+      claimed_.fetch_sub(1, std::memory_order_relaxed);
+      collisions++;
+    }
+  }
+  return !worker.descents.empty();
+}
+
+void MCTS::BackupBatch(Worker &worker) {
+  for (Leaf &leaf : worker.leaves) {
+    leaf.v = Expand(worker, leaf);
+    leaf.node->SetExpanded();
+  }
+  for (const Descent &descent : worker.descents) {
+    const int leaf = descent.leaf;
+    Backup(worker, descent, leaf >= 0 ? worker.leaves[leaf].v : descent.v);
+  }
 }
 
 Policy MCTS::GetPolicy(State& state, Move &best, float temp, bool dirichlet) {
-  MoveList moves;
   Policy pi;
+  if (!Start(state, best, pi)) return pi;
+
+  while (budget_ > 0) {
+    search_temp_ = temp;
+    if (!threads_.empty()) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      generation_++;
+      running_ = threads_.size();
+    }
+    start_cv_.notify_all();
+    Simulate(*workers_[0], state, temp);
+    if (!threads_.empty()) {
+      // leaves the batch to the threads still searching
+      nn_.DecreaseBatchSize(batch_);
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_cv_.wait(lock, [&] { return running_ == 0; });
+      nn_.IncreaseBatchSize(batch_);
+    }
+    if (!over_limit_) break;
+    Shrink();
+  }
+  return Finish(best, dirichlet);
+}
+
+bool MCTS::Start(State &state, Move &best, Policy &pi) {
   pi.fill(0.0f);
-  int num_moves = state.LegalMoves(moves);
-  for (int i = 0; i < simulations_; i++) {
-    Search(state, 0, temp);
+
+  // the final round is played exactly once it can be solved
+  FactoryMap map;
+  State canonical = state.Canonical(&map);
+  int value;
+  Move move;
+  if (workers_[0]->solver.Solve(canonical, &value, &move, root_nodes_)) {
+    best = map.FromCanonical(move);
+    pi[best.Id()] = 1.0f;
+    DropTree();
+    saved_ = 0;
+    return false;
   }
 
-  std::size_t s, a;
-  s = std::hash<State>()(state);
-  float sum = 0.0f, eta, p;
-  constexpr float eps = 0.25f;
-  float pbest = std::numeric_limits<float>::lowest();
+  // a tree left by Advance() already holds visits of this state
+  search_limit_ = tree_limit_;
+  if (!root_ || root_->solved != Node::kUnsolved ||
+      std::hash<State>()(root_state_) != std::hash<State>()(state)) {
+    DropTree();
+    root_ = New<Node>();
+    root_state_ = state;
+  }
+  stopped_ = false;
+  kl_total_ = 0;
+  noise_.clear();
+  NewBudget();
+  return true;
+}
 
-  for (int i = 0; i < num_moves; i++) {
-    a = std::hash<Move>()(moves[i]);
-    if (Nsa_.find(s ^ a) == Nsa_.end()) {
-      continue;
+bool MCTS::Gather(float temp) {
+  CHECK(threads_.empty()) << "Stepped searches run on a single thread";
+  Worker &worker = *workers_[0];
+  for (;;) {
+    if (GatherBatch(worker, root_state_, temp)) {
+      if (worker.slots) return true;
+      // nothing to evaluate, the descents ended in known values
+      BackupBatch(worker);
+    } else if (over_limit_) {
+      Shrink();
+    } else {
+      return false;
     }
+  }
+}
 
-    pi[a] = p = Nsa_[s ^ a];
+void MCTS::Backup() { BackupBatch(*workers_[0]); }
 
-    if (dirichlet) {
-      eta = utils::Random::Get().GetGamma(alpha_, 1.0);
-      p = (1.0f - eps) * pi[a] + eps * eta;
-    }
+Policy MCTS::Finish(Move &best, bool dirichlet) {
+  Policy pi;
+  pi.fill(0.0f);
+  float sum = 0.0f, p;
+  float pbest = std::numeric_limits<float>::lowest();
+
+  for (int i = 0; i < root_->num_edges; i++) {
+    const Edge &edge = root_->edges[i];
+    pi[edge.move] = p = edge.visits;
+
+    if (dirichlet) p = (1.0f - eps_) * pi[edge.move] + eps_ * Noise()[i];
 
     if (p > pbest) {
       pbest = p;
-      best = moves[i];
+      best = Move(edge.move);
     }
 
-    sum += pi[a];
+    sum += pi[edge.move];
   }
 
-  for (auto &&x : pi) x /= sum;
+  if (sum > 0.0f) {
+    for (auto &&x : pi) x /= sum;
+  } else if (root_->num_edges) {
+    // no visits below the root, uniform over its moves
+    for (int i = 0; i < root_->num_edges; i++) {
+      pi[root_->edges[i].move] = 1.0f / root_->num_edges;
+    }
+  } else {
+    // the root isn't even expanded
+    MoveList moves;
+    State state = root_state_;
+    const int n = state.LegalMoves(moves);
+    for (int i = 0; i < n; i++) pi[moves[i].Id()] = 1.0f / n;
+    best = moves[0];
+  }
 
+  saved_ = stopped_ ? std::max(0, simulations_ - root_->visits) : 0;
   return pi;
 }
 
-float MCTS::Search(State& state, int depth, float temp) {
-  if (state.IsTerminal()) return state.Outcome();
+void MCTS::Seed(uint64_t seed) {
+  for (size_t i = 0; i < workers_.size(); i++) {
+    workers_[i]->rng.Seed(seed + i);
+  }
+  noise_rng_.Seed(seed + workers_.size());
+}
 
-  MoveList moves;
-  int n = state.LegalMoves(moves);
-  std::size_t s = std::hash<State>()(state), a;
-  float v;
+const std::vector<float> &MCTS::Noise() {
+  if (noise_.empty()) {
+    std::gamma_distribution<float> gamma(alpha_, 1.0f);
+    for (int i = 0; i < root_->num_edges; i++) {
+      noise_.push_back(gamma(noise_rng_));
+    }
+  }
+  return noise_;
+}
+
+void MCTS::NewBudget() {
+  budget_ = simulations_ - root_->visits;
+  claimed_ = 0;
+  over_limit_ = false;
+}
+
+bool MCTS::Claim() {
+  if (stopped_.load(std::memory_order_relaxed)) return false;
+  const int n = claimed_.fetch_add(1, std::memory_order_relaxed);
+  if (n >= budget_) return false;
+  if (stop_early_ && n % stop_interval_ == 0 && CanStop()) {
+    stopped_.store(true, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+// true if the move with the highest score (1 - eps) * visits + eps * noise,
+// the first of equal scores, keeps it even if all simulations left go to
+// another move. Without noise the score is the visits alone.
+static bool Decided(const int *visits, const float *noise, float eps, int n,
+                    int left) {
+  float scores[kNumMoves];
+  int best = 0;
+  for (int i = 0; i < n; i++) {
+    scores[i] = (1.0f - eps) * visits[i] + (noise ? eps * noise[i] : 0.0f);
+    if (scores[i] > scores[best]) best = i;
+  }
+  for (int i = 0; i < n; i++) {
+    if (i != best && scores[i] + (1.0f - eps) * left >= scores[best]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool MCTS::CanStop() {
+  std::lock_guard<std::mutex> lock(stop_mutex_);
+  if (!root_->IsExpanded()) return false;
+
+  // one snapshot of the visits, the other threads go on updating them
+  const int num_edges = root_->num_edges;
+  int visits[kNumMoves];
+  int total = 0;
+  for (int i = 0; i < num_edges; i++) {
+    visits[i] = root_->edges[i].visits.load(std::memory_order_relaxed);
+    total += visits[i];
+  }
+  // Finish() picks the same move after the simulations left whether it adds
+  // noise or not
+  const int left = simulations_ - total;
+  if (Decided(visits, nullptr, eps_, num_edges, left) &&
+      Decided(visits, Noise().data(), eps_, num_edges, left)) {
+    return true;
+  }
 
-  if (Ns_.find(s) == Ns_.end()) {
-    // prepare input planes
-    state.MakePlanes(planes_);
-    // wait for a network batch to fill up
-    nn_.InputReady();
-    v = *v_;
-//    v = utils::Random::Get().GetFloat(2.0f) - 1.0f;
-    float sum = 0.0f, p;
+  if (kl_gain_ <= 0.0f || total < kl_total_ + kl_interval_) return false;
+  // KL divergence of the visits now from the visits of the last check, a
+  // move visited for the first time since then never stops the search
+  float kl = 0.0f;
+  bool stop = kl_total_ > 0;
+  for (int i = 0; stop && i < num_edges; i++) {
+    if (visits[i] == 0) continue;
+    if (kl_visits_[i] == 0) {
+      stop = false;
+      break;
+    }
+    const float p = float(visits[i]) / total;
+    const float q = float(kl_visits_[i]) / kl_total_;
+    kl += p * std::log(p / q);
+  }
+  stop = stop && kl < kl_gain_ * (total - kl_total_);
 
-    for (int i = 0; i < n; i++) {
-      a = std::hash<Move>()(moves[i]);
-      p = policy_[a];
-//      p = utils::Random::Get().GetFloat(1.0f);
-      sum += p;
-      Psa_[s ^ a] = p;
-      Nsa_[s ^ a] = 0;
-      Wsa_[s ^ a] = 0.0f;
-      Qsa_[s ^ a] = 0.0f;
+  kl_visits_.assign(visits, visits + num_edges);
+  kl_total_ = total;
+  return stop;
+}
+
+void MCTS::Shrink() {
+  // drop the least visited subtrees until half of the limit is left
+  int min_visits = 2;
+  do {
+    Compact(root_, min_visits);
+    min_visits *= 2;
+  } while (arena_.Bytes() > tree_limit_ / 2 && min_visits <= root_->visits);
+  if (arena_.Bytes() > tree_limit_ / 2) search_limit_ = 2 * arena_.Bytes();
+  NewBudget();
+}
+
+bool MCTS::Search(Worker &worker, State &state, Node *node, int depth,
+                  float temp, float *v) {
+  if (state.IsTerminal()) {
+    *v = state.Outcome();
+    return true;
+  }
+
+  Node::Status status = node->status.load(std::memory_order_acquire);
+  if (status == Node::NEW &&
+      node->status.compare_exchange_strong(status, Node::BUSY,
+                                           std::memory_order_acquire)) {
+    worker.NewBatch();
+    if (Queue(worker, state, node, depth, v)) {
+      // wait for a network batch to fill up
+      nn_.InputReady();
+      *v = Expand(worker, worker.leaves[0]);
     }
+    node->SetExpanded();
+    return true;
+  }
+  if (status != Node::EXPANDED) {
+    worker.pending = node;
+    return false;
+  }
+  if (node->solved != Node::kUnsolved) {
+    *v = node->solved;
+    return true;
+  }
+
+  Edge *ebest = Select(node, depth, temp);
+
+  // descend on the same state and take the move back afterwards
+  ebest->virtual_loss.fetch_add(1, std::memory_order_relaxed);
+  bool done = true;
+  int turn = state.Turn();
+  auto record = state.Play(Move(ebest->move));
+  if (state.IsTerminal()) {
+    // the outcome is already seen from the player that moved
+    *v = state.Outcome();
+  } else {
+    Node *child = Child(worker, state, ebest);
+    done = Search(worker, state, child, depth + 1, temp, v);
+    if (done && turn != state.Turn()) *v = -*v;
+  }
+  state.Undo(record);
+  ebest->virtual_loss.fetch_sub(1, std::memory_order_relaxed);
+  if (!done) return false;
 
-    for (int i = 0; i < n; i++) {
-      a = std::hash<Move>()(moves[i]);
-      Psa_[s ^ a] /= sum;
+  node->visits.fetch_add(1, std::memory_order_relaxed);
+  ebest->visits.fetch_add(1, std::memory_order_relaxed);
+  ebest->AddValue(*v);
+  if (tt_) tt_->Update(node->key, *v, depth);
+  return true;
+}
+
+void MCTS::Descend(Worker &worker, State state, float temp) {
+  Descent descent{int(worker.path.size()), 0, Descent::kDone, 0.0f};
+  Node *node = root_;
+  for (int depth = 0;; depth++) {
+    if (state.IsTerminal()) {
+      descent.v = state.Outcome();
+      break;
+    }
+    Node::Status status = node->status.load(std::memory_order_acquire);
+    if (status == Node::NEW &&
+        node->status.compare_exchange_strong(status, Node::BUSY,
+                                             std::memory_order_acquire)) {
+      if (Queue(worker, state, node, depth, &descent.v)) {
+        descent.leaf = worker.leaves.size() - 1;
+      } else {
+        node->SetExpanded();
+      }
+      break;
+    }
+    // pending in this batch or in the batch of another thread
+    if (status != Node::EXPANDED) {
+      descent.leaf = Descent::kCollided;
+      worker.pending = node;
+      break;
+    }
+    if (node->solved != Node::kUnsolved) {
+      descent.v = node->solved;
+      break;
     }
 
-    Ns_[s] = 0;
-    return v;
+    Edge *edge = Select(node, depth, temp);
+    edge->virtual_loss.fetch_add(1, std::memory_order_relaxed);
+    worker.path.push_back({node, edge, false});
+    const int turn = state.Turn();
+    state.Play(Move(edge->move));
+    // the outcome is already seen from the player that moved
+    if (state.IsTerminal()) {
+      descent.v = state.Outcome();
+      break;
+    }
+    node = Child(worker, state, edge);
+    worker.path.back().flip = turn != state.Turn();
   }
+  descent.end = worker.path.size();
+  worker.descents.push_back(descent);
+}
 
+void MCTS::Backup(Worker &worker, const Descent &descent, float v) {
+  for (int i = descent.end - 1; i >= descent.begin; i--) {
+    const Step &step = worker.path[i];
+    if (step.flip) v = -v;
+    step.edge->virtual_loss.fetch_sub(1, std::memory_order_relaxed);
+    if (descent.leaf == Descent::kCollided) continue;
+    step.node->visits.fetch_add(1, std::memory_order_relaxed);
+    step.edge->visits.fetch_add(1, std::memory_order_relaxed);
+    step.edge->AddValue(v);
+    if (tt_) tt_->Update(step.node->key, v, i - descent.begin);
+  }
+}
+
+Edge *MCTS::Select(Node *node, int depth, float temp) const {
   float ubest = std::numeric_limits<float>::lowest();
-  Move abest;
+  Edge *ebest = node->edges;
+  const float sqrt_n = std::sqrt(node->visits.load(std::memory_order_relaxed));
 
-  for (int i = 0; i < n; i++) {
-    a = std::hash<Move>()(moves[i]);
-    float nsa = depth < depth_ ? Nsa_[s ^ a] : std::pow(Nsa_[s ^ a], 1.0f / temp);
-    float u = std::sqrt(Ns_[s]) / (1.0f + nsa);
-    u *= cpuct_ * Psa_[s ^ a];
-    u += Qsa_[s ^ a];
+  for (Edge *edge = node->edges, *end = edge + node->num_edges; edge != end;
+       edge++) {
+    const int n = edge->visits.load(std::memory_order_relaxed);
+    const int vl = edge->virtual_loss.load(std::memory_order_relaxed);
+    float nsa = depth < depth_ ? n + vl : std::pow(n + vl, 1.0f / temp);
+    float u = sqrt_n / (1.0f + nsa);
+    u *= cpuct_ * edge->prior;
+    float q = EdgeQ(node, *edge);
+    // threads below the edge count as lost visits
+    if (vl) q = (q * n - virtual_loss_ * vl) / (n + vl);
+    u += q;
     if (u > ubest) {
       ubest = u;
-      abest = moves[i];
+      ebest = edge;
     }
   }
 
-  State state_prime = state;
-  state_prime.Step(abest);
-  v = Search(state_prime, depth + 1, temp);
-  if (state.Turn() != state_prime.Turn()) v = -v;
-  a = std::hash<Move>()(abest);
-  Ns_[s]++;
-  Nsa_[s ^ a]++;
-  Wsa_[s ^ a] += v;
-  Qsa_[s ^ a] = Wsa_[s ^ a] / Nsa_[s ^ a];
+  return ebest;
+}
+
+Node *MCTS::Child(Worker &worker, State &state, Edge *edge) {
+  Node *child = edge->child.load(std::memory_order_acquire);
+  if (!child) {
+    // a node lost to another thread stays unused in the arena
+    Node *fresh = New<Node>();
+    if (edge->child.compare_exchange_strong(child, fresh)) child = fresh;
+  }
+  if (state.IsChance()) {
+    const ChanceEdge &chance = SampleChance(worker, state, child);
+    state.ApplyChance(chance.chance);
+    child = chance.child;
+  }
+  return child;
+}
+
+bool MCTS::Queue(Worker &worker, State &state, Node *node, int depth,
+                 float *v) {
+  // transposed factories share one evaluation, see State::Canonical()
+  FactoryMap map;
+  State canonical = state.Canonical(&map);
+  node->key = std::hash<State>()(canonical);
+  node->turn = state.Turn();
+
+  // exact outcome in place of a network evaluation
+  int value;
+  if (worker.solver.Solve(canonical, &value, nullptr, leaf_nodes_)) {
+    node->solved = value;
+    *v = value;
+    return false;
+  }
+
+  Leaf leaf{node, map, canonical.LegalMask(), depth, worker.slots, 0.0f};
+  if (prune_) leaf.legal = canonical.PruneFloorOverflow(leaf.legal);
+  Policy policy;
+  if (cache_ && cache_->Lookup(node->key, leaf.legal, policy.data(), v)) {
+    AddEdges(leaf, policy.data(), *v);
+    return false;
+  }
+  for (const Leaf &other : worker.leaves) {
+    if (other.node->key == node->key) leaf.slot = other.slot;
+  }
+  // the network expands the packed state to input planes
+  if (leaf.slot == worker.slots) {
+    canonical.Pack(worker.record[worker.slots++].data());
+  }
+  worker.leaves.push_back(leaf);
+  return true;
+}
 
+float MCTS::Expand(Worker &worker, const Leaf &leaf) {
+  const float *policy = worker.policy + leaf.slot * kNumMoves;
+  const float v = worker.v[leaf.slot];
+  if (cache_) cache_->Insert(leaf.node->key, leaf.legal, policy, v);
+  AddEdges(leaf, policy, v);
   return v;
 }
 
+void MCTS::AddEdges(const Leaf &leaf, const float *policy, float v) {
+  Node *node = leaf.node;
+  node->num_edges = leaf.legal.Count();
+  node->edges = New<Edge>(node->num_edges);
+
+  float sum = 0.0f;
+  Edge *edge = node->edges;
+  for (uint8_t a : leaf.legal) {
+    edge->prior = policy[a];
+    edge->move = leaf.map.FromCanonical(a);
+    sum += edge->prior;
+    edge++;
+  }
+  // a policy that underflows over the legal moves gives no preference
+  for (edge = node->edges; edge != node->edges + node->num_edges; edge++) {
+    edge->prior = sum > 0.0f ? edge->prior / sum : 1.0f / node->num_edges;
+  }
+
+  if (tt_) tt_->Update(node->key, v, leaf.depth);
+}
+
+float MCTS::EdgeQ(const Node *node, const Edge &edge) const {
+  const Node *child = edge.child.load(std::memory_order_acquire);
+  if (!tt_ || !child || !child->IsExpanded()) return edge.Q();
+  auto stats = tt_->Probe(child->key);
+  if (stats.visits <= edge.visits.load(std::memory_order_relaxed)) {
+    return edge.Q();
+  }
+  return child->turn == node->turn ? stats.q : -stats.q;
+}
+
+const ChanceEdge &MCTS::SampleChance(Worker &worker, const State &state,
+                                      Node *node) {
+  // the first visits draw new refills, later ones pick one of them
+  node->Lock();
+  if (!node->chances) node->chances = New<ChanceEdge>(chance_children_);
+  ChanceEdge *chance;
+  if (node->num_chances < chance_children_) {
+    chance = &node->chances[node->num_chances++];
+    chance->chance = state.SampleChance(worker.rng);
+    chance->child = New<Node>();
+  } else {
+    chance = &node->chances[worker.rng.Bounded(chance_children_)];
+    // the subtree may have been dropped, see LimitTree()
+    if (!chance->child) chance->child = New<Node>();
+  }
+  node->Unlock();
+  return *chance;
+}
+
+template <typename T>
+T *MCTS::New(size_t n) {
+  std::lock_guard<std::mutex> lock(arena_mutex_);
+  T *p = arena_.New<T>(n);
+  if (tree_limit_ && arena_.Bytes() > search_limit_) over_limit_ = true;
+  return p;
+}
+
+void MCTS::Advance(Move move, const State &next) {
+  if (!root_ || !root_->IsExpanded()) return DropTree();
+
+  Node *child = nullptr;
+  for (int i = 0; i < root_->num_edges; i++) {
+    if (root_->edges[i].move == move.Id()) child = root_->edges[i].child;
+  }
+
+  const uint64_t hash = std::hash<State>()(next);
+  State state = root_state_;
+  state.Play(move);
+  if (child && child->chances) {
+    // the refill that was drawn has to be among the sampled ones
+    Node *drawn = nullptr;
+    for (int i = 0; i < child->num_chances; i++) {
+      State refilled = state;
+      refilled.ApplyChance(child->chances[i].chance);
+      if (std::hash<State>()(refilled) == hash) {
+        drawn = child->chances[i].child;
+      }
+    }
+    child = drawn;
+  } else if (std::hash<State>()(state) != hash) {
+    child = nullptr;
+  }
+
+  if (!child) return DropTree();
+  Compact(child, 0);
+  root_state_ = next;
+}
+
+Node *MCTS::Copy(const Node *node, int min_visits) {
+  // no search runs, the statistics are stable
+  Node *copy = spare_.New<Node>();
+  copy->key = node->key;
+  copy->num_edges = node->num_edges;
+  copy->solved = node->solved;
+  copy->turn = node->turn;
+  copy->status = node->status.load();
+  copy->visits = node->visits.load();
+  copy->num_chances = node->num_chances;
+  if (node->edges) {
+    copy->edges = spare_.New<Edge>(node->num_edges);
+    for (int i = 0; i < node->num_edges; i++) {
+      const Edge &edge = node->edges[i];
+      Edge &to = copy->edges[i];
+      to.prior = edge.prior;
+      to.value_sum = edge.value_sum.load();
+      to.visits = edge.visits.load();
+      to.move = edge.move;
+      const Node *child = edge.child;
+      if (child && edge.visits >= min_visits) {
+        to.child = Copy(child, min_visits);
+      }
+    }
+  }
+  if (node->chances) {
+    // a chance node lives as long as the edge leading to it
+    copy->chances = spare_.New<ChanceEdge>(chance_children_);
+    for (int i = 0; i < node->num_chances; i++) {
+      const ChanceEdge &chance = node->chances[i];
+      copy->chances[i] = chance;
+      copy->chances[i].child =
+          chance.child && chance.child->visits >= min_visits
+              ? Copy(chance.child, min_visits)
+              : nullptr;
+    }
+  }
+  return copy;
+}
+
+void MCTS::Compact(Node *root, int min_visits) {
+  spare_.Reset();
+  root_ = Copy(root, min_visits);
+  arena_.Swap(spare_);
+  spare_.Reset();
+}
+
+void MCTS::DropTree() {
+  arena_.Reset();
+  root_ = nullptr;
+}
+
 void MCTS::Clear() {
-  Ns_.clear();
-  Nsa_.clear();
-  Qsa_.clear();
-  Psa_.clear();
-  Wsa_.clear();
+  DropTree();
+  for (auto &worker : workers_) worker->solver.Clear();
 }
@@ -1,37 +1,266 @@
 #pragma once
 
-#include <unordered_map>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "azul/move.h"
+#include "azul/solver.h"
+#include "nncache.h"
+#include "node.h"
+#include "ttable.h"
+#include "utils/random.h"
 
 using Policy = std::array<float, kNumMoves>;
 
-class State;
 class NeuralNet;
 
 class MCTS {
  public:
-  explicit MCTS(NeuralNet &net);
+  // prune skips moves that overflow to the floor needlessly, a heuristic that
+  // may skip the best move, see State::PruneFloorOverflow(). Their policy
+  // targets are always 0 then. huge_pages backs the tree with 2 MB pages.
+  // Searches that share tt share the statistics of transposed states.
+  // threads search the same tree, every thread takes batch slots of the
+  // network. The network batch counts threads * batch slots for a search,
+  // a thread leaves it while it waits for a search or for a node another
+  // thread expands. With batch > 1 a thread gathers up to batch leaves per
+  // network request instead of waiting on every single one.
+  explicit MCTS(NeuralNet &net, bool prune = false, bool huge_pages = false,
+                TranspositionTable *tt = nullptr, int threads = 1,
+                int batch = 1);
+  ~MCTS();
 
   Policy GetPolicy(State &state, Move &best, float temp=1.0f, bool dirichlet=true);
+  // GetPolicy() in steps for callers that evaluate the leaves themselves,
+  // e.g. one thread running the searches of many games. Start() returns
+  // false if the final round solver already set best and pi. Every Gather()
+  // that returns true queues leaves in the network slots, they are evaluated
+  // before Backup(). Finish() returns the policy once Gather() is false.
+  // Needs a single thread.
+  bool Start(State &state, Move &best, Policy &pi);
+  bool Gather(float temp = 1.0f);
+  void Backup();
+  Policy Finish(Move &best, bool dirichlet = true);
+  // moves the root to the state after move, next, keeping the subtree that
+  // was already searched below it. Without it the next GetPolicy() starts
+  // from an empty tree.
+  void Advance(Move move, const State &next);
   void Clear();
-
+  // bytes taken by the search tree
+  size_t TreeBytes() const { return arena_.Bytes(); }
+  // caps the tree at bytes, the least visited subtrees are dropped once a
+  // search exceeds it. A search whose tree can't be halved that way grows on
+  // up to twice its size before the next try. 0 lifts the cap.
+  void LimitTree(size_t bytes) { tree_limit_ = bytes; }
+  // leaves found in cache skip the network, evaluations of the network are
+  // added to it. Searches can share one cache.
+  void UseCache(NNCache *cache) { cache_ = cache; }
+  // visits of the root a search stops at, 800 by default
+  void SetSimulations(int n) { simulations_ = n; }
+  // stops searches once the simulations left can't change the move
+  // Finish() picks, with or without Dirichlet noise. With kl_gain > 0 also
+  // once the visit distribution of the root changes by less than kl_gain
+  // (KL divergence) per simulation.
+  void StopEarly(bool enabled, float kl_gain = 0.0f) {
+    stop_early_ = enabled;
+    kl_gain_ = kl_gain;
+  }
+  // simulations the last search saved by stopping early
+  int SavedSimulations() const { return saved_; }
+  // seeds the random draws of the searches, refills sampled in the tree and
+  // the noise of Finish(). Single thread searches of equal seeds and trees
+  // are equal.
+  void Seed(uint64_t seed);
 
  private:
-  std::unordered_map<std::size_t, int> Ns_;
-  std::unordered_map<std::size_t, int> Nsa_;
-  std::unordered_map<std::size_t, float> Qsa_;
-  std::unordered_map<std::size_t, float> Psa_;
-  std::unordered_map<std::size_t, float> Wsa_;
+  // leaf waiting for its network evaluation
+  struct Leaf {
+    Node *node;
+    FactoryMap map;
+    MoveMask legal;  ///< moves of the canonical state
+    int depth;
+    int slot;  ///< network slot, shared by transpositions
+    float v;
+  };
+  // edge taken by a descent, flip if the value changes sides below it
+  struct Step {
+    Node *node;
+    Edge *edge;
+    bool flip;
+  };
+  // descent of a batched search along path[begin, end)
+  struct Descent {
+    static constexpr int kDone = -1;      ///< v is known, no leaf
+    static constexpr int kCollided = -2;  ///< hit a leaf that is pending
+    int begin;
+    int end;
+    int leaf;  ///< index of the leaf, or kDone or kCollided
+    float v;
+  };
+
+  // everything a search thread owns
+  struct Worker {
+    // first of the batch_ network slots of the thread
+    State::Record *record;
+    float *policy;
+    float *v;
+    Solver solver;
+    // the batch of leaves being gathered
+    std::vector<Leaf> leaves;
+    std::vector<Step> path;
+    std::vector<Descent> descents;
+    int slots{0};
+    // node another thread was expanding when the last descent collided
+    const Node *pending{nullptr};
+    // refills of chance nodes
+    utils::Xoshiro256 rng;
+
+    void NewBatch() {
+      leaves.clear();
+      path.clear();
+      descents.clear();
+      slots = 0;
+      pending = nullptr;
+    }
+  };
+
+  // the tree of the current search, reused by the next GetPolicy() on the
+  // same state, see Advance()
+  NodeArena arena_;
+  // the surviving subtree is copied here on Advance() and when the tree
+  // outgrows its limit, then both arenas swap
+  NodeArena spare_;
+  Node *root_{nullptr};
+  State root_state_;
+  size_t tree_limit_{0};
+  std::mutex arena_mutex_;
+  // set by allocations beyond tree_limit_, the threads stop and the tree is
+  // compacted
+  std::atomic<bool> over_limit_{false};
+  // tree_limit_ of the current search, raised to twice the tree when a
+  // compaction can't get it under half of the limit, so the tree is copied
+  // again only once it has doubled
+  size_t search_limit_{0};
+
+  // workers_[0] is the thread calling GetPolicy(), the others wait in
+  // WorkerLoop() for the next search
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  int generation_{0};
+  int running_{0};
+  bool stop_{false};
+  // temperature of the search the threads work on, root_state_ is the state
+  float search_temp_{1.0f};
+  // simulations left and taken by the threads
+  int budget_{0};
+  std::atomic<int> claimed_{0};
+  int simulations_{800};
+
+  // early stopping, see StopEarly()
+  bool stop_early_{false};
+  float kl_gain_{0.0f};
+  std::atomic<bool> stopped_{false};
+  std::mutex stop_mutex_;
+  // root visits per edge at the last divergence check
+  std::vector<int> kl_visits_;
+  int kl_total_{0};
+  int saved_{0};
+  // Dirichlet noise of the root edges, drawn once per search, see Noise()
+  std::vector<float> noise_;
+  utils::Xoshiro256 noise_rng_;
 
+  // virtual visits added to an edge per thread below it
+  static constexpr float virtual_loss_{1.0f};
   static constexpr float cpuct_{2.5f};
-  static constexpr int simulations_{800};
+  // simulations between two checks of the stopping rules
+  static constexpr int stop_interval_{8};
+  // simulations the visit distribution is compared over
+  static constexpr int kl_interval_{100};
   static constexpr int depth_{20};
   static constexpr float alpha_{0.2f};
+  // share of the noise in the scores of Finish()
+  static constexpr float eps_{0.25f};
+  // solver node budgets, a leaf that needs more is evaluated by the network
+  static constexpr int root_nodes_{1 << 16};
+  static constexpr int leaf_nodes_{1 << 12};
+  // refills sampled per round end, more visits share their subtrees
+  static constexpr int chance_children_{8};
 
   NeuralNet &nn_;
-  float *planes_;
-  float *policy_;
-  float *v_;
+  const bool prune_;
+  // leaves gathered per network request
+  const int batch_;
+  TranspositionTable *tt_;
+  NNCache *cache_{nullptr};
 
-  float Search(State &state, int depth, float temp);
+  void WorkerLoop(int id);
+  // simulations of one thread until the budget is used up
+  void Simulate(Worker &worker, State &state, float temp);
+  // leaves the network batch until another thread has expanded node
+  void WaitFor(const Node *node);
+  // same for batch_ > 1, descents gather leaves that are evaluated at once
+  void SimulateBatch(Worker &worker, const State &state, float temp);
+  // starts a new batch of worker and descends until batch_ leaves are
+  // queued, false if no simulation is left
+  bool GatherBatch(Worker &worker, const State &state, float temp);
+  // expands the evaluated leaves and backs up all descents of the batch
+  void BackupBatch(Worker &worker);
+  // simulations left for the current root
+  void NewBudget();
+  // takes a simulation of the budget, false once it is used up or the
+  // search stops early
+  bool Claim();
+  // true if a stopping rule of StopEarly() holds
+  bool CanStop();
+  // noise of the root edges, drawn on the first call of a search such that
+  // CanStop() and Finish() see the same noise
+  const std::vector<float> &Noise();
+  // compacts a tree over its limit
+  void Shrink();
+  // false if another thread is expanding a node on the path, v is unset and
+  // no statistics change then
+  bool Search(Worker &worker, State &state, Node *node, int depth, float temp,
+              float *v);
+  // descends from the root with virtual loss on the path until it reaches a
+  // leaf, adds it to worker.descents
+  void Descend(Worker &worker, State state, float temp);
+  // takes the virtual loss of a descent back and updates the statistics
+  // unless it collided
+  void Backup(Worker &worker, const Descent &descent, float v);
+  // edge with the highest upper confidence bound
+  Edge *Select(Node *node, int depth, float temp) const;
+  // node after the move of edge, state is after the move and gets the refill
+  // of a chance node
+  Node *Child(Worker &worker, State &state, Edge *edge);
+  // queues a new leaf in worker.leaves and packs its canonical state to a
+  // slot, a transposition queued before shares the slot. False if the solver
+  // gives the exact value v instead or the leaf is expanded from the cache.
+  bool Queue(Worker &worker, State &state, Node *node, int depth,
+             float *v);
+  // expands a leaf evaluated by the network, returns its value
+  float Expand(Worker &worker, const Leaf &leaf);
+  // creates the edges of a leaf from the network policy
+  void AddEdges(const Leaf &leaf, const float *policy, float v);
+  // mean value of an edge, taken from the table when a transposition of the
+  // child has seen more visits than the edge
+  float EdgeQ(const Node *node, const Edge &edge) const;
+  // refill and subtree of a chance node
+  const ChanceEdge &SampleChance(Worker &worker, const State &state,
+                                 Node *node);
+  // thread safe allocation from arena_
+  template <typename T>
+  T *New(size_t n = 1);
+  // copies the subtree of node to spare_, children of edges with fewer than
+  // min_visits visits are left out
+  Node *Copy(const Node *node, int min_visits);
+  // makes the subtree of root the whole tree
+  void Compact(Node *root, int min_visits);
+  void DropTree();
 };
\ No newline at end of file
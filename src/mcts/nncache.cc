@@ -0,0 +1,123 @@
+#include "nncache.h"
+
+#include <algorithm>
+
+#include "half.h"
+
+void NNCache::Shard::Unlink(uint32_t i) {
+  Entry &entry = entries[i];
+  if (entry.prev != kNone) {
+    entries[entry.prev].next = entry.next;
+  } else {
+    head = entry.next;
+  }
+  if (entry.next != kNone) {
+    entries[entry.next].prev = entry.prev;
+  } else {
+    tail = entry.prev;
+  }
+}
+
+void NNCache::Shard::PushFront(uint32_t i) {
+  entries[i].prev = kNone;
+  entries[i].next = head;
+  if (head != kNone) entries[head].prev = i;
+  head = i;
+  if (tail == kNone) tail = i;
+}
+
+NNCache::NNCache(size_t mb)
+    : shards_(new Shard[kShards]),
+      capacity_(std::max<size_t>(1, (mb << 20) / kShards / sizeof(Entry))) {
+  for (int i = 0; i < kShards; i++) {
+    shards_[i].entries.reserve(capacity_);
+    shards_[i].index.reserve(capacity_);
+  }
+}
+
+bool NNCache::Lookup(uint64_t key, const MoveMask &legal, float *policy,
+                     float *v) {
+  Shard &shard = ShardOf(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.index.find(key);
+  // a different number of moves is a collision of two keys
+  if (it == shard.index.end() ||
+      shard.entries[it->second].num_moves != legal.Count()) {
+    shard.misses++;
+    return false;
+  }
+
+  const uint32_t i = it->second;
+  const Entry &entry = shard.entries[i];
+  const uint16_t *prior = entry.priors;
+  for (int a : legal) policy[a] = FromHalf(*prior++);
+  *v = entry.v;
+  shard.Unlink(i);
+  shard.PushFront(i);
+  shard.hits++;
+  return true;
+}
+
+void NNCache::Insert(uint64_t key, const MoveMask &legal, const float *policy,
+                     float v) {
+  const int num_moves = legal.Count();
+  if (num_moves > kMaxMoves) return;
+
+  Shard &shard = ShardOf(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  uint32_t i;
+  auto it = shard.index.find(key);
+  if (it != shard.index.end()) {
+    i = it->second;
+    shard.Unlink(i);
+  } else if (shard.entries.size() < capacity_) {
+    i = shard.entries.size();
+    shard.entries.emplace_back();
+    shard.index.emplace(key, i);
+  } else {
+    // the least recently used entry is replaced
+    i = shard.tail;
+    shard.Unlink(i);
+    // the node of the map is reused, no allocation
+    auto node = shard.index.extract(shard.entries[i].key);
+    node.key() = key;
+    shard.index.insert(std::move(node));
+  }
+
+  Entry &entry = shard.entries[i];
+  entry.key = key;
+  entry.v = v;
+  entry.num_moves = num_moves;
+  uint16_t *prior = entry.priors;
+  for (int a : legal) *prior++ = ToHalf(policy[a]);
+  shard.PushFront(i);
+}
+
+void NNCache::Clear() {
+  for (int i = 0; i < kShards; i++) {
+    Shard &shard = shards_[i];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.entries.clear();
+    shard.index.clear();
+    shard.head = shard.tail = kNone;
+    shard.hits = shard.misses = 0;
+  }
+}
+
+uint64_t NNCache::Hits() const {
+  uint64_t hits = 0;
+  for (int i = 0; i < kShards; i++) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    hits += shards_[i].hits;
+  }
+  return hits;
+}
+
+uint64_t NNCache::Misses() const {
+  uint64_t misses = 0;
+  for (int i = 0; i < kShards; i++) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    misses += shards_[i].misses;
+  }
+  return misses;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "azul/move.h"
+
+// Network evaluations shared by all searches, keyed by the zobrist hash of a
+// canonical state. An entry keeps the value and the policy of the legal moves
+// only, as fp16 in the order of the move mask. The key picks one of kShards
+// shards that each hold a fixed number of entries behind a lock of their own,
+// the least recently used entry of a full shard makes room for a new one.
+class NNCache {
+ public:
+  static constexpr int kShards = 64;
+  // 5 factories of up to 4 colors and the center of up to 5, times 6 lines
+  static constexpr int kMaxMoves = 150;
+
+  // mb is the memory of all entries, split evenly between the shards
+  explicit NNCache(size_t mb);
+
+  // false on a miss, policy gets the priors of the moves in legal and v the
+  // value otherwise
+  bool Lookup(uint64_t key, const MoveMask &legal, float *policy, float *v);
+  // stores the priors of the moves in legal out of policy and v
+  void Insert(uint64_t key, const MoveMask &legal, const float *policy,
+              float v);
+  void Clear();
+
+  size_t Bytes() const { return kShards * capacity_ * sizeof(Entry); }
+  // entries a shard holds, the top 6 bits of a key pick its shard
+  size_t Capacity() const { return capacity_; }
+  uint64_t Hits() const;
+  uint64_t Misses() const;
+
+ private:
+  static constexpr uint32_t kNone = ~0u;
+
+  struct Entry {
+    uint64_t key;
+    float v;
+    // neighbours in the recently used order of the shard
+    uint32_t prev;
+    uint32_t next;
+    uint8_t num_moves;
+    uint16_t priors[kMaxMoves];
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::vector<Entry> entries;
+    std::unordered_map<uint64_t, uint32_t> index;
+    // most and least recently used entry
+    uint32_t head{kNone};
+    uint32_t tail{kNone};
+    uint64_t hits{0};
+    uint64_t misses{0};
+
+    void Unlink(uint32_t i);
+    void PushFront(uint32_t i);
+  };
+
+  std::unique_ptr<Shard[]> shards_;
+  size_t capacity_;  ///< entries per shard
+
+  // the high bits of the key, the low ones index the maps
+  Shard &ShardOf(uint64_t key) const { return shards_[key >> 58]; }
+  static_assert(kShards == 64, "ShardOf() takes 6 bits of the key");
+};
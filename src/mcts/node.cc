@@ -0,0 +1,28 @@
+#include "node.h"
+
+#include <glog/logging.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+NodeArena::~NodeArena() {
+  for (char *block : blocks_) free(block);
+}
+
+void *NodeArena::Allocate(size_t bytes, size_t align) {
+  DCHECK(bytes <= kBlockSize);
+  offset_ = (offset_ + align - 1) & ~(align - 1);
+  if (blocks_.empty() || offset_ + bytes > kBlockSize) {
+    if (!blocks_.empty()) block_++;
+    offset_ = 0;
+    if (block_ == blocks_.size()) {
+      // aligned to the block size such that a block can be a single huge page
+      char *block = static_cast<char *>(aligned_alloc(kBlockSize, kBlockSize));
+      CHECK(block) << "Out of memory for the search tree";
+      if (huge_pages_) madvise(block, kBlockSize, MADV_HUGEPAGE);
+      blocks_.push_back(block);
+    }
+  }
+  void *p = blocks_[block_] + offset_;
+  offset_ += bytes;
+  return p;
+}
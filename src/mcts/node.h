@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "azul/state.h"
+
+struct Node;
+
+// Statistics are updated by all search threads, see MCTS. They are read with
+// relaxed atomics, a selection may see a slightly stale tree.
+
+// move from a node, statistics are seen from the player that makes it
+struct Edge {
+  float prior{0.0f};
+  std::atomic<float> value_sum{0.0f};
+  std::atomic<int> visits{0};
+  // threads currently searching below the edge, each counts as a lost visit
+  std::atomic<int> virtual_loss{0};
+  uint8_t move{0};  ///< move id in the node's own (not canonical) state
+  std::atomic<Node *> child{nullptr};
+
+  float Q() const {
+    const int n = visits.load(std::memory_order_relaxed);
+    return n ? value_sum.load(std::memory_order_relaxed) / n : 0.0f;
+  }
+  void AddValue(float v) {
+    float sum = value_sum.load(std::memory_order_relaxed);
+    while (!value_sum.compare_exchange_weak(sum, sum + v,
+                                            std::memory_order_relaxed)) {
+    }
+  }
+};
+
+// refill sampled at a round end and the subtree that follows it
+struct ChanceEdge {
+  State::Chance chance;
+  Node *child;
+};
+
+// Search tree node. A decision node owns the edges of its legal moves once it
+// has been evaluated, a chance node (the state after a round ending move)
+// owns the refills sampled so far.
+struct Node {
+  static constexpr int8_t kUnsolved = -2;
+  // expansion status, a single thread expands a node
+  enum Status : uint8_t { NEW, BUSY, EXPANDED };
+
+  // set before the node is EXPANDED and constant afterwards
+  Edge *edges{nullptr};
+  uint64_t key{0};  ///< hash of the canonical state
+  uint8_t num_edges{0};
+  int8_t solved{kUnsolved};  ///< exact value of a solved final round state
+  uint8_t turn{0};           ///< player to move
+
+  std::atomic<Status> status{NEW};
+  std::atomic<int> visits{0};
+  // guards the refills of a chance node
+  std::atomic<bool> locked{false};
+  uint8_t num_chances{0};
+  ChanceEdge *chances{nullptr};
+
+  bool IsExpanded() const {
+    return status.load(std::memory_order_acquire) == EXPANDED;
+  }
+  // ends an expansion and wakes the threads that collided with it
+  void SetExpanded() {
+    status.store(EXPANDED, std::memory_order_release);
+    status.notify_all();
+  }
+  // blocks while another thread expands the node
+  void WaitExpanded() const { status.wait(BUSY, std::memory_order_acquire); }
+  void Lock() {
+    while (locked.exchange(true, std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+  }
+  void Unlock() { locked.store(false, std::memory_order_release); }
+};
+
+// Bump allocator for the search tree. Memory comes in blocks that are kept on
+// Reset(), so dropping a tree is O(1) and the next search reuses memory that
+// is already mapped. With huge pages every block is backed by one 2 MB page
+// to cut TLB misses of the scattered tree walks.
+class NodeArena {
+ public:
+  static constexpr size_t kBlockSize = 2 << 20;
+
+  explicit NodeArena(bool huge_pages = false) : huge_pages_(huge_pages) {}
+  ~NodeArena();
+  NodeArena(const NodeArena &) = delete;
+  NodeArena &operator=(const NodeArena &) = delete;
+
+  // n default constructed objects, valid until Reset()
+  template <typename T>
+  T *New(size_t n = 1) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "arena objects are never destroyed");
+    T *p = static_cast<T *>(Allocate(n * sizeof(T), alignof(T)));
+    for (size_t i = 0; i < n; i++) new (p + i) T();
+    return p;
+  }
+
+  void Reset() {
+    block_ = 0;
+    offset_ = 0;
+  }
+  // exchanges the memory of two arenas, see MCTS::Advance()
+  void Swap(NodeArena &other) {
+    std::swap(blocks_, other.blocks_);
+    std::swap(block_, other.block_);
+    std::swap(offset_, other.offset_);
+  }
+  // bytes handed out since the last Reset()
+  size_t Bytes() const { return block_ * kBlockSize + offset_; }
+  // bytes reserved from the system
+  size_t Capacity() const { return blocks_.size() * kBlockSize; }
+
+ private:
+  std::vector<char *> blocks_;
+  size_t block_{0};
+  size_t offset_{0};
+  const bool huge_pages_;
+
+  void *Allocate(size_t bytes, size_t align);
+};
@@ -0,0 +1,160 @@
+#include "mcts/mcts.h"
+
+#include <gtest/gtest.h>
+#include <utils/random.h>
+
+#include <cmath>
+
+#include "azul/state.h"
+#include "mcts/nncache.h"
+#include "neural/neuralnet.h"
+
+// Searches against the stub network of the benchmarks, it forms batches like
+// the real one: a thread that is counted in the batch and never sends its
+// slots stalls every search.
+
+static constexpr int kSimulations = 200;
+
+// searches the first plies of a game with threads sharing the tree, each
+// taking batch leaves per network request
+static void Play(int threads, int batch, int plies) {
+  NeuralNet net;
+  net.DecreaseBatchSize(net.MaxBatchSize() - threads * batch);
+  MCTS mcts(net, false, false, nullptr, threads, batch);
+  mcts.SetSimulations(kSimulations);
+  utils::Xoshiro256 rng(7);
+  State state;
+  state.Reset(rng);
+
+  for (int ply = 0; ply < plies && !state.IsTerminal(); ply++) {
+    Move best;
+    Policy pi = mcts.GetPolicy(state, best, 1.0f, false);
+    float sum = 0.0f;
+    for (float p : pi) sum += p;
+    EXPECT_NEAR(sum, 1.0f, 1e-5f);
+    EXPECT_GT(pi[best.Id()], 0.0f);
+    if (ply == 0) {
+      // a new tree, all simulations but the one expanding the root are
+      // visits of its edges
+      for (float p : pi) {
+        const float visits = p * (kSimulations - 1);
+        EXPECT_NEAR(visits, std::round(visits), 1e-3f);
+      }
+    }
+    state.Step(best, rng);
+    mcts.Advance(best, state);
+  }
+}
+
+TEST(MCTSTest, SingleThread) { Play(1, 1, 10); }
+
+TEST(MCTSTest, Threads) {
+  Play(2, 1, 10);
+  Play(4, 1, 10);
+}
+
+TEST(MCTSTest, BatchedThreads) {
+  Play(1, 4, 10);
+  Play(2, 2, 10);
+  Play(4, 8, 10);
+}
+
+TEST(MCTSTest, NoVisits) {
+  NeuralNet net;
+  net.DecreaseBatchSize(net.MaxBatchSize() - 1);
+  MCTS mcts(net);
+  utils::Xoshiro256 rng(3);
+  State state;
+  state.Reset(rng);
+  MoveList moves;
+  const int n = state.LegalMoves(moves);
+
+  // no simulation at all, and one that only expands the root
+  for (int simulations : {0, 1}) {
+    mcts.SetSimulations(simulations);
+    mcts.Clear();
+    Move best;
+    Policy pi = mcts.GetPolicy(state, best, 1.0f, false);
+    for (int i = 0; i < n; i++) EXPECT_EQ(pi[moves[i].Id()], 1.0f / n);
+    EXPECT_GT(pi[best.Id()], 0.0f);
+  }
+}
+
+TEST(MCTSTest, ZeroPriors) {
+  NeuralNet net;
+  net.DecreaseBatchSize(net.MaxBatchSize() - 1);
+  MCTS mcts(net);
+  NNCache cache(1);
+  mcts.UseCache(&cache);
+  mcts.SetSimulations(kSimulations);
+  utils::Xoshiro256 rng(3);
+  State state;
+  state.Reset(rng);
+
+  // the root is expanded from a policy that is 0 on every legal move
+  FactoryMap map;
+  State canonical = state.Canonical(&map);
+  const float zeros[kNumMoves] = {};
+  cache.Insert(std::hash<State>()(canonical), canonical.LegalMask(), zeros,
+               0.0f);
+
+  // uniform priors spread the visits, NaN priors sent all to one move
+  Move best;
+  Policy pi = mcts.GetPolicy(state, best, 1.0f, false);
+  int visited = 0;
+  for (float p : pi) visited += p > 0.0f;
+  EXPECT_GT(visited, 1);
+}
+
+TEST(MCTSTest, Seed) {
+  // searches that run one after the other, each with a batch of its own
+  NeuralNet net_a, net_b;
+  net_a.DecreaseBatchSize(net_a.MaxBatchSize() - 1);
+  net_b.DecreaseBatchSize(net_b.MaxBatchSize() - 1);
+  MCTS a(net_a), b(net_b);
+  utils::Xoshiro256 rng(3);
+  State state;
+  state.Reset(rng);
+
+  // noise and refills come from the seed, not from the thread
+  a.Seed(11);
+  b.Seed(11);
+  Move best_a, best_b;
+  utils::Random::Get().Seed(1);
+  Policy pi_a = a.GetPolicy(state, best_a, 1.0f, true);
+  utils::Random::Get().Seed(2);
+  Policy pi_b = b.GetPolicy(state, best_b, 1.0f, true);
+  EXPECT_EQ(pi_a, pi_b);
+  EXPECT_EQ(best_a.Id(), best_b.Id());
+}
+
+TEST(MCTSTest, EarlyStopNoise) {
+  // a search stopped early picks the move of the full search, noise included
+  NeuralNet net_a, net_b;
+  net_a.DecreaseBatchSize(net_a.MaxBatchSize() - 1);
+  net_b.DecreaseBatchSize(net_b.MaxBatchSize() - 1);
+  MCTS a(net_a), b(net_b);
+  a.SetSimulations(kSimulations);
+  b.SetSimulations(kSimulations);
+  a.StopEarly(true);
+  utils::Xoshiro256 rng(5);
+  State state;
+  state.Reset(rng);
+
+  // the stub network knows nothing, leads only show with a few moves left
+  int saved = 0;
+  MoveList moves;
+  for (int ply = 0; !state.IsTerminal(); ply++) {
+    a.Clear();
+    b.Clear();
+    a.Seed(ply);
+    b.Seed(ply);
+    Move best_a, best_b;
+    a.GetPolicy(state, best_a, 1e-5f, true);
+    b.GetPolicy(state, best_b, 1e-5f, true);
+    EXPECT_EQ(best_a.Id(), best_b.Id()) << ply;
+    saved += a.SavedSimulations();
+    state.Step(moves[rng() % state.LegalMoves(moves)], rng);
+  }
+  EXPECT_GT(saved, 0);
+}
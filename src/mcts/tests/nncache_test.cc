@@ -0,0 +1,199 @@
+#include "mcts/nncache.h"
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <new>
+
+#include "mcts/half.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// allocations of the test, a full shard reuses its entries and map nodes
+static size_t allocations = 0;
+
+void *operator new(size_t size) {
+  allocations++;
+  if (void *p = malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// every 3rd move legal, n moves
+static MoveMask Legal(int n) {
+  MoveMask legal;
+  legal.Clear();
+  for (int i = 0; i < n; i++) legal.Set(3 * i);
+  return legal;
+}
+
+// keys below 2^58 share shard 0, the priors and the value tell them apart
+static void Insert(NNCache &cache, uint64_t key, int n = 10) {
+  float policy[kNumMoves] = {};
+  for (int a : Legal(n)) policy[a] = (key % 97 + a + 1) / 512.0f;
+  cache.Insert(key, Legal(n), policy, (key % 7) / 8.0f);
+}
+
+static bool Lookup(NNCache &cache, uint64_t key, int n = 10) {
+  float policy[kNumMoves], v;
+  return cache.Lookup(key, Legal(n), policy, &v);
+}
+
+TEST(NNCacheTest, RoundTrip) {
+  NNCache cache(1);
+  float policy[kNumMoves], v;
+  EXPECT_FALSE(cache.Lookup(5, Legal(10), policy, &v));
+
+  Insert(cache, 5);
+  for (float &p : policy) p = -1.0f;
+  ASSERT_TRUE(cache.Lookup(5, Legal(10), policy, &v));
+  EXPECT_EQ(v, 5 / 8.0f);
+  const MoveMask legal = Legal(10);
+  for (int a = 0; a < kNumMoves; a++) {
+    if (legal.Test(a)) {
+      // exact in fp16
+      EXPECT_EQ(policy[a], (5 + a + 1) / 512.0f);
+    } else {
+      EXPECT_EQ(policy[a], -1.0f);
+    }
+  }
+
+  // priors are rounded to 11 significant bits
+  float in[kNumMoves] = {};
+  for (int a : legal) in[a] = 1.0f / (a + 3);
+  cache.Insert(5, legal, in, -0.5f);
+  ASSERT_TRUE(cache.Lookup(5, legal, policy, &v));
+  EXPECT_EQ(v, -0.5f);
+  for (int a : legal) EXPECT_NEAR(policy[a], in[a], in[a] / 2048);
+}
+
+TEST(NNCacheTest, LeastRecentlyUsed) {
+  NNCache cache(1);
+  const uint64_t capacity = cache.Capacity();
+  ASSERT_GT(capacity, 2u);
+  // another shard keeps its entries
+  const uint64_t other = 1ull << 58;
+  Insert(cache, other);
+
+  for (uint64_t key = 1; key <= capacity; key++) Insert(cache, key);
+  // a hit makes 1 the most recently used entry, 2 goes first
+  EXPECT_TRUE(Lookup(cache, 1));
+  Insert(cache, capacity + 1);
+  EXPECT_FALSE(Lookup(cache, 2));
+  EXPECT_TRUE(Lookup(cache, 1));
+  EXPECT_TRUE(Lookup(cache, capacity + 1));
+
+  // an insert of a key that is cached updates it in place
+  Insert(cache, 3);
+  Insert(cache, capacity + 2);
+  EXPECT_TRUE(Lookup(cache, 3));
+  EXPECT_FALSE(Lookup(cache, 4));
+  for (uint64_t key = 5; key <= capacity + 2; key++) {
+    EXPECT_TRUE(Lookup(cache, key));
+  }
+  EXPECT_TRUE(Lookup(cache, other));
+}
+
+TEST(NNCacheTest, EvictionReusesNodes) {
+  NNCache cache(1);
+  const uint64_t capacity = cache.Capacity();
+  for (uint64_t key = 0; key < capacity; key++) Insert(cache, key);
+
+  allocations = 0;
+  for (uint64_t key = capacity; key < 4 * capacity; key++) {
+    Insert(cache, key);
+  }
+  const size_t evicting = allocations;
+  EXPECT_EQ(evicting, 0u);
+  EXPECT_FALSE(Lookup(cache, 3 * capacity - 1));
+  EXPECT_TRUE(Lookup(cache, 3 * capacity));
+}
+
+TEST(NNCacheTest, MoveCountCollision) {
+  NNCache cache(1);
+  Insert(cache, 9, 10);
+  // a key with another number of legal moves belongs to another state
+  EXPECT_FALSE(Lookup(cache, 9, 11));
+  EXPECT_EQ(cache.Misses(), 1u);
+  EXPECT_TRUE(Lookup(cache, 9, 10));
+  EXPECT_EQ(cache.Hits(), 1u);
+}
+
+TEST(NNCacheTest, Counters) {
+  NNCache cache(1);
+  // keys of several shards add up
+  for (uint64_t shard = 0; shard < 4; shard++) {
+    Insert(cache, shard << 58 | 1);
+    EXPECT_TRUE(Lookup(cache, shard << 58 | 1));
+    EXPECT_TRUE(Lookup(cache, shard << 58 | 1));
+    EXPECT_FALSE(Lookup(cache, shard << 58 | 2));
+  }
+  EXPECT_EQ(cache.Hits(), 8u);
+  EXPECT_EQ(cache.Misses(), 4u);
+
+  cache.Clear();
+  EXPECT_EQ(cache.Hits(), 0u);
+  EXPECT_EQ(cache.Misses(), 0u);
+  EXPECT_FALSE(Lookup(cache, 1));
+}
+
+TEST(HalfTest, Portable) {
+  EXPECT_EQ(ToHalfPortable(0.0f), 0x0000);
+  EXPECT_EQ(ToHalfPortable(1.0f), 0x3c00);
+  EXPECT_EQ(ToHalfPortable(65504.0f), 0x7bff);
+  EXPECT_EQ(ToHalfPortable(1e9f), 0x7bff);
+  // ties between two halves go to the even one
+  EXPECT_EQ(ToHalfPortable(1.0f + ldexpf(1, -11)), 0x3c00);
+  EXPECT_EQ(ToHalfPortable(1.0f + ldexpf(3, -11)), 0x3c02);
+  // subnormals, 2^-24 is the smallest
+  EXPECT_EQ(ToHalfPortable(ldexpf(1, -24)), 0x0001);
+  EXPECT_EQ(ToHalfPortable(ldexpf(1, -25)), 0x0000);
+  EXPECT_EQ(ToHalfPortable(ldexpf(3, -26)), 0x0001);
+  EXPECT_EQ(ToHalfPortable(ldexpf(3, -25)), 0x0002);
+  EXPECT_EQ(ToHalfPortable(ldexpf(1023, -24)), 0x03ff);
+  // the carry of a rounding makes a normal number
+  EXPECT_EQ(ToHalfPortable(ldexpf(2047, -25)), 0x0400);
+  EXPECT_EQ(FromHalfPortable(0x0001), ldexpf(1, -24));
+  EXPECT_EQ(FromHalfPortable(0x0400), ldexpf(1, -14));
+
+  for (uint32_t h = 0; h <= 0x7bff; h++) {
+    ASSERT_EQ(ToHalfPortable(FromHalfPortable(h)), h);
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("f16c"))) static uint16_t F16cToHalf(float f) {
+  return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+}
+
+__attribute__((target("f16c"))) static float F16cFromHalf(uint16_t h) {
+  return _cvtsh_ss(h);
+}
+
+TEST(HalfTest, MatchesF16C) {
+  __builtin_cpu_init();
+  if (!__builtin_cpu_supports("f16c")) GTEST_SKIP() << "no F16C";
+
+  for (uint32_t h = 0; h <= 0x7bff; h++) {
+    ASSERT_EQ(FromHalfPortable(h), F16cFromHalf(h)) << h;
+  }
+  // the value halfway between two halves and its neighbours, subnormals
+  // included
+  for (uint32_t h = 0; h < 0x7bff; h++) {
+    const float tie = (FromHalfPortable(h) + FromHalfPortable(h + 1)) / 2;
+    for (float f : {tie, nextafterf(tie, 0.0f), nextafterf(tie, 1e9f)}) {
+      ASSERT_EQ(ToHalfPortable(f), F16cToHalf(f)) << f;
+    }
+  }
+  // floats up to the largest half
+  for (uint32_t x = 0; x <= 0x477fe000; x += 4099) {
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    ASSERT_EQ(ToHalfPortable(f), F16cToHalf(f)) << f;
+  }
+}
+#endif
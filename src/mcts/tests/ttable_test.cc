@@ -0,0 +1,121 @@
+#include "mcts/ttable.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+// 1 MB holds 2^15 buckets, the low 15 bits of a key pick the bucket and the
+// high 16 bits are its check
+static constexpr uint64_t kBuckets = 1 << 15;
+
+static uint64_t Key(uint64_t check, uint64_t bucket) {
+  return check << 48 | bucket;
+}
+
+TEST(TranspositionTableTest, RoundTrip) {
+  TranspositionTable tt(1);
+  EXPECT_EQ(tt.Bytes(), kBuckets * 32);
+  EXPECT_EQ(tt.Probe(Key(1, 5)).visits, 0);
+
+  tt.Update(Key(1, 5), 0.5f, 3);
+  auto stats = tt.Probe(Key(1, 5));
+  EXPECT_EQ(stats.visits, 1);
+  EXPECT_NEAR(stats.q, 0.5f, 1e-6f);
+
+  // q is the running mean, kept to 22 bits
+  const float values[] = {1.0f, -1.0f, 0.25f, -0.3f, 0.7f};
+  float sum = 0.5f;
+  for (float v : values) {
+    tt.Update(Key(1, 5), v, 3);
+    sum += v;
+  }
+  stats = tt.Probe(Key(1, 5));
+  EXPECT_EQ(stats.visits, 6);
+  EXPECT_NEAR(stats.q, sum / 6, 1e-5f);
+
+  // values outside of [-1, 1] are clamped
+  tt.Update(Key(2, 5), 3.0f, 0);
+  EXPECT_EQ(tt.Probe(Key(2, 5)).q, 1.0f);
+
+  tt.Clear();
+  EXPECT_EQ(tt.Probe(Key(1, 5)).visits, 0);
+  EXPECT_EQ(tt.Hashfull(), 0);
+}
+
+TEST(TranspositionTableTest, Check) {
+  TranspositionTable tt(1);
+  tt.Update(Key(1, 5), 0.5f, 0);
+
+  // same bucket, another state
+  EXPECT_EQ(tt.Probe(Key(2, 5)).visits, 0);
+  EXPECT_EQ(tt.Probe(Key(1, 5 + kBuckets / 2)).visits, 0);
+  tt.Update(Key(2, 5), -0.5f, 0);
+  EXPECT_EQ(tt.Probe(Key(1, 5)).visits, 1);
+  EXPECT_NEAR(tt.Probe(Key(1, 5)).q, 0.5f, 1e-6f);
+  EXPECT_NEAR(tt.Probe(Key(2, 5)).q, -0.5f, 1e-6f);
+}
+
+TEST(TranspositionTableTest, Replacement) {
+  TranspositionTable tt(1);
+  // a full bucket, visits 5, 1, 3 and 2 at the root
+  const int visits[] = {5, 1, 3, 2};
+  for (int i = 0; i < TranspositionTable::kBucketSize; i++) {
+    for (int n = 0; n < visits[i]; n++) tt.Update(Key(i + 1, 9), 0.0f, 0);
+  }
+
+  // the least visited entry makes room
+  tt.Update(Key(10, 9), 0.0f, 0);
+  EXPECT_EQ(tt.Probe(Key(10, 9)).visits, 1);
+  EXPECT_EQ(tt.Probe(Key(2, 9)).visits, 0);
+  for (int i : {1, 3, 4}) EXPECT_EQ(tt.Probe(Key(i, 9)).visits, visits[i - 1]);
+
+  // with equal visits the entry found deepest in the tree goes
+  tt.Clear();
+  const int depths[] = {0, 48, 2, 1};
+  for (int i = 0; i < TranspositionTable::kBucketSize; i++) {
+    for (int n = 0; n < 4; n++) tt.Update(Key(i + 1, 9), 0.0f, depths[i]);
+  }
+  tt.Update(Key(10, 9), 0.0f, 0);
+  EXPECT_EQ(tt.Probe(Key(2, 9)).visits, 0);
+  for (int i : {1, 3, 4, 10}) EXPECT_GT(tt.Probe(Key(i, 9)).visits, 0);
+
+  // a visit closer to the root lowers the depth of an entry, else the 5
+  // visits at depth 48 would be worth less than 2 at the root
+  tt.Clear();
+  for (int n = 0; n < 4; n++) tt.Update(Key(1, 9), 0.0f, 48);
+  for (int i = 2; i <= TranspositionTable::kBucketSize; i++) {
+    for (int n = 0; n < 2; n++) tt.Update(Key(i, 9), 0.0f, 0);
+  }
+  tt.Update(Key(1, 9), 0.0f, 0);
+  tt.Update(Key(10, 9), 0.0f, 0);
+  EXPECT_EQ(tt.Probe(Key(1, 9)).visits, 5);
+  EXPECT_EQ(tt.Probe(Key(2, 9)).visits, 0);
+}
+
+TEST(TranspositionTableTest, ConcurrentUpdates) {
+  TranspositionTable tt(1);
+  constexpr int kThreads = 8;
+  constexpr int kUpdates = 20000;
+
+  // one entry updated by all threads and one of its own per thread
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&tt, t] {
+      for (int i = 0; i < kUpdates; i++) {
+        tt.Update(Key(1, 3), 0.25f, 1);
+        tt.Update(Key(2, 4 + t), t % 2 ? 1.0f : -1.0f, 0);
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+
+  auto stats = tt.Probe(Key(1, 3));
+  EXPECT_EQ(stats.visits, kThreads * kUpdates);
+  EXPECT_NEAR(stats.q, 0.25f, 1e-4f);
+  for (int t = 0; t < kThreads; t++) {
+    stats = tt.Probe(Key(2, 4 + t));
+    EXPECT_EQ(stats.visits, kUpdates);
+    EXPECT_NEAR(stats.q, t % 2 ? 1.0f : -1.0f, 1e-4f);
+  }
+}
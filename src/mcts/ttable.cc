@@ -0,0 +1,123 @@
+#include "ttable.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr int kDepthBits = 6;
+static constexpr int kVisitBits = 20;
+static constexpr int kQBits = 22;
+
+static constexpr uint64_t kMaxDepth = (1ull << kDepthBits) - 1;
+static constexpr uint64_t kMaxVisits = (1ull << kVisitBits) - 1;
+// q in [-1, 1] maps to [0, 2 * kQScale]
+static constexpr float kQScale = (1 << (kQBits - 1)) - 1;
+
+static constexpr int kQShift = 0;
+static constexpr int kVisitShift = kQShift + kQBits;
+static constexpr int kDepthShift = kVisitShift + kVisitBits;
+static constexpr int kCheckShift = kDepthShift + kDepthBits;
+static_assert(kCheckShift == 48, "an entry is one 64 bit word");
+
+static uint64_t Check(uint64_t entry) { return entry >> kCheckShift; }
+static int Depth(uint64_t entry) { return (entry >> kDepthShift) & kMaxDepth; }
+static int Visits(uint64_t entry) {
+  return (entry >> kVisitShift) & kMaxVisits;
+}
+static float Q(uint64_t entry) {
+  return float(entry & ((1ull << kQBits) - 1)) / kQScale - 1.0f;
+}
+
+static uint64_t Pack(uint64_t check, uint64_t depth, uint64_t visits,
+                     float q) {
+  q = std::min(std::max(q, -1.0f), 1.0f);
+  uint64_t bits = std::lround((q + 1.0f) * kQScale);
+  return check << kCheckShift | depth << kDepthShift |
+         visits << kVisitShift | bits << kQShift;
+}
+
+// entries with few visits found deep in the tree are replaced first
+static int Worth(uint64_t entry) {
+  return Visits(entry) * 16 / (Depth(entry) + 16);
+}
+
+TranspositionTable::TranspositionTable(size_t mb) {
+  size_t buckets = std::max<size_t>(mb << 20, sizeof(Bucket)) / sizeof(Bucket);
+  // round down to a power of two
+  while (buckets & (buckets - 1)) buckets &= buckets - 1;
+  buckets_.reset(new Bucket[buckets]);
+  mask_ = buckets - 1;
+  Clear();
+}
+
+void TranspositionTable::Clear() {
+  for (size_t i = 0; i <= mask_; i++) {
+    for (auto &e : buckets_[i].entries) e.store(0, std::memory_order_relaxed);
+  }
+}
+
+auto TranspositionTable::Probe(uint64_t key) const -> Stats {
+  const uint64_t check = key >> kCheckShift;
+  for (auto &e : BucketOf(key).entries) {
+    const uint64_t entry = e.load(std::memory_order_relaxed);
+    if (Check(entry) == check && Visits(entry) > 0) {
+      return {Visits(entry), Q(entry)};
+    }
+  }
+  return {0, 0.0f};
+}
+
+void TranspositionTable::Update(uint64_t key, float v, int depth) {
+  const uint64_t check = key >> kCheckShift;
+  const uint64_t d = std::min<uint64_t>(depth, kMaxDepth);
+  auto &entries = BucketOf(key).entries;
+
+  for (;;) {
+    // add the visit to the stored entry
+    std::atomic<uint64_t> *victim = nullptr;
+    uint64_t victim_entry = 0;
+    for (auto &e : entries) {
+      uint64_t entry = e.load(std::memory_order_relaxed);
+      if (Check(entry) == check && Visits(entry) > 0) {
+        for (;;) {
+          const int n = Visits(entry);
+          if (n == int(kMaxVisits)) return;
+          const float q = Q(entry) + (v - Q(entry)) / (n + 1);
+          const uint64_t next =
+              Pack(check, std::min<uint64_t>(Depth(entry), d), n + 1, q);
+          if (e.compare_exchange_weak(entry, next,
+                                      std::memory_order_relaxed)) {
+            return;
+          }
+          // taken over by another state in the meantime
+          if (Check(entry) != check || Visits(entry) == 0) break;
+        }
+        victim = nullptr;
+        break;
+      }
+      if (!victim || Worth(entry) < Worth(victim_entry)) {
+        victim = &e;
+        victim_entry = entry;
+      }
+    }
+
+    // or replace the least valuable one
+    if (victim && victim->compare_exchange_strong(
+                      victim_entry, Pack(check, d, 1, v),
+                      std::memory_order_relaxed)) {
+      return;
+    }
+  }
+}
+
+int TranspositionTable::Hashfull() const {
+  const size_t n = std::min<size_t>(1000, mask_ + 1);
+  int used = 0;
+  for (size_t i = 0; i < n; i++) {
+    for (auto &e : buckets_[i].entries) {
+      used += Visits(e.load(std::memory_order_relaxed)) > 0;
+    }
+  }
+  return used * 1000 / (n * kBucketSize);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+// Fixed-size table of search statistics shared by all threads, keyed by the
+// zobrist hash of a canonical state. Every entry is a single 64 bit word:
+//
+//   check:16 | depth:6 | visits:20 | q:22
+//
+// The low bits of the key pick a bucket of 4 entries and the high 16 bits
+// are kept as check, a probe only matches if both agree. Updates are
+// compare-and-swap loops on the word, no locks are taken. A new state takes
+// the slot of the least valuable entry of its bucket, entries found close
+// to the root and with many visits are kept the longest.
+class TranspositionTable {
+ public:
+  struct Stats {
+    int visits;
+    float q;  ///< mean value for the player to move
+  };
+
+  static constexpr int kBucketSize = 4;
+
+  // mb is rounded down to a power of two nof buckets
+  explicit TranspositionTable(size_t mb);
+
+  // statistics of a state, visits is 0 if it isn't stored
+  Stats Probe(uint64_t key) const;
+  // adds a visit with value v for the player to move, depth is the distance
+  // to the search root the state was found at
+  void Update(uint64_t key, float v, int depth);
+  void Clear();
+
+  size_t Bytes() const { return (mask_ + 1) * sizeof(Bucket); }
+  // stored entries out of the first 1000 buckets, per mille
+  int Hashfull() const;
+
+ private:
+  struct Bucket {
+    std::atomic<uint64_t> entries[kBucketSize];
+  };
+
+  std::unique_ptr<Bucket[]> buckets_;
+  size_t mask_;
+
+  Bucket &BucketOf(uint64_t key) const { return buckets_[key & mask_]; }
+};
@@ -73,6 +73,7 @@ Gpu::Gpu(int id, const std::vector<char> &net) {
     batch.work.resize(max_batch_size_);
     batches_.emplace_back(batch);
   }
+  records_.resize(max_batch_size_);
   cudaSafeCall(cudaDeviceSynchronize());
 }
 
@@ -110,13 +111,10 @@ void Gpu::Forward() {
   auto out1 = bindings_[1];
   auto out2 = bindings_[2];
 
-  // copy memory into host buffer
-  for (int i = 0; i < max_batch_size_; i++) {
-    auto dst = reinterpret_cast<float *>(batch.cpu[input]) + i * sizes_[input];
-    auto src = batch.work[i].planes.data();
-    auto size = sizes_[input] * sizeof(float);
-    memcpy(dst, src, size);
-  }
+  // expand the packed states into the host buffer
+  for (int i = 0; i < max_batch_size_; i++) records_[i] = batch.work[i].record;
+  State::MakePlanes(records_.data(), max_batch_size_,
+                    reinterpret_cast<float *>(batch.cpu[input]));
 
   // copy input batch to device memory
   cudaSafeCall(cudaMemcpyAsync(batch.gpu[input], batch.cpu[input],
@@ -9,12 +9,15 @@
 #include <thread>
 #include <vector>
 
+#include "azul/state.h"
+
 namespace nv = nvinfer1;
 using output_t = std::pair<std::vector<float>, float>;
 
 struct work_t {
   work_t() = default;
-  std::vector<float> planes;
+  // packed state, expanded to input planes by the gpu thread
+  State::Record record;
   std::shared_ptr<std::promise<output_t>> result;
 };
 
@@ -43,6 +46,7 @@ class Gpu {
   nv::ICudaEngine *engine_;
   nv::IExecutionContext *context_;
   std::vector<batch_t> batches_;
+  std::vector<State::Record> records_;
 };
 
 class GpuManager {
@@ -9,7 +9,9 @@ NeuralNet::NeuralNet()
     : max_batch_size_(0),
       batch_size_(0),
       soft_max_batch_size_(0),
-      buffer_index_(0) {
+      buffer_index_(0),
+      generation_(0),
+      forwarding_(false) {
   logger_ = std::make_unique<Logger>();
   for (int i = 0; i < kNumBuffers; i++) {
     gpu_buffers_[i] = nullptr;
@@ -45,6 +47,7 @@ void NeuralNet::Load(const std::string &filename) {
   sizes_[input_id_] = max_batch_size_ * 49 * 5 * 5 * sizeof(float);
   sizes_[policy_id_] = max_batch_size_ * 180 * sizeof(float);
   sizes_[value_id_] = max_batch_size_ * sizeof(float);
+  records_.assign(max_batch_size_, State::Record{});
 
   cudaSafeCall(
       cudaMallocHost((void **)&host_buffers_[input_id_], sizes_[input_id_]));
@@ -65,52 +68,72 @@ void NeuralNet::Load(const std::string &filename) {
   VLOG(1) << "  Input DataType: " << dt[int(engine_->getBindingDataType(0))];
 }
 
-NeuralNet::NetBuffer NeuralNet::GetBuffers() {
+NeuralNet::NetBuffer NeuralNet::GetBuffers(int n) {
   std::lock_guard<std::mutex> lock(mutex_);
-  float *input = &host_buffers_[input_id_][buffer_index_ * 49 * 5 * 5];
+  CHECK(buffer_index_ + n <= max_batch_size_) << "Out of network slots";
+  State::Record *input = &records_[buffer_index_];
   float *policy = &host_buffers_[policy_id_][buffer_index_ * 180];
   float *value = &host_buffers_[value_id_][buffer_index_];
   VLOG(1) << buffer_index_;
-  buffer_index_++;
+  buffer_index_ += n;
   return std::make_tuple(input, policy, value);
 }
 
-void NeuralNet::InputReady() {
-  bool ready = false;
+void NeuralNet::InputReady(int n) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  // a thread that joined the batch during a forward pass is in the next one
+  cv_.wait(lock, [&] { return !forwarding_; });
+  batch_size_ += n;
+  const int generation = generation_;
 
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    batch_size_++;
-    ready = batch_size_ == soft_max_batch_size_;
-  }
-
-  if (ready) {
+  if (batch_size_ == soft_max_batch_size_) {
+    forwarding_ = true;
+    lock.unlock();
     Forward();
-    batch_size_ = 0;
-    cv_.notify_all();
+    Done();
   } else {
-    std::unique_lock lock(mutex_);
-    cv_.wait(lock);
+    // the batch may already be done before this thread waits
+    cv_.wait(lock, [&] { return generation_ != generation; });
   }
 }
 
-void NeuralNet::DecreaseBatchSize() {
+void NeuralNet::DecreaseBatchSize(int n) {
   bool ready = false;
 
   {
     std::lock_guard<std::mutex> lock(mutex_);
-    soft_max_batch_size_--;
-    ready = batch_size_ == soft_max_batch_size_;
+    soft_max_batch_size_ -= n;
+    ready = !forwarding_ && batch_size_ > 0 &&
+            batch_size_ == soft_max_batch_size_;
+    if (ready) forwarding_ = true;
   }
 
   if (ready) {
     Forward();
+    Done();
+  }
+}
+
+void NeuralNet::IncreaseBatchSize(int n) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  // the batch on the gpu reads all slots, the thread writes its own after
+  cv_.wait(lock, [&] { return !forwarding_; });
+  soft_max_batch_size_ += n;
+}
+
+void NeuralNet::Done() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
     batch_size_ = 0;
-    cv_.notify_all();
+    generation_++;
+    forwarding_ = false;
   }
+  cv_.notify_all();
 }
 
 void NeuralNet::Forward() {
+  State::MakePlanes(records_.data(), max_batch_size_,
+                    host_buffers_[input_id_]);
   // copy data to gpu
   cudaSafeCall(cudaMemcpy(gpu_buffers_[input_id_], host_buffers_[input_id_],
                           sizes_[input_id_], cudaMemcpyHostToDevice));
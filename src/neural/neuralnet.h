@@ -5,6 +5,8 @@
 #include <mutex>
 #include <vector>
 
+#include "azul/state.h"
+
 namespace nv = nvinfer1;
 class Logger;
 
@@ -12,24 +14,33 @@ static constexpr int kNumBuffers = 3;
 
 class NeuralNet {
  public:
-  using NetBuffer = std::tuple<float*, float*, float*>;
+  using NetBuffer = std::tuple<State::Record*, float*, float*>;
   NeuralNet();
   ~NeuralNet();
 
   // Deserialize the tensorrt network from disk and construct engine
   void Load(const std::string &filename);
 
-  // Obtains 3 buffers (input, policy, value)
-  NetBuffer GetBuffers();
+  // Obtains 3 buffers (packed state, policy, value) of n consecutive slots,
+  // the packed states are expanded to input planes right before the forward
+  // pass
+  NetBuffer GetBuffers(int n = 1);
 
-  // Indicate that the input is ready for this thread. This function is called
-  // from multiple threads and will perform inference when the batch is filled.
+  // Indicate that the n slots of this thread are ready. This function is
+  // called from multiple threads and will perform inference when the batch is
+  // filled.
   //
-  // NOTE: Make sure to never spawn more threads than the max batch size
-  void InputReady();
+  // NOTE: Make sure to never take more slots than the max batch size
+  void InputReady(int n = 1);
 
-  // Reduces the batchsize (useful for when a thread is finished)
-  void DecreaseBatchSize();
+  // Reduces the batchsize by n slots (useful for when a thread is finished).
+  // A thread that has nothing to evaluate for a while must leave the batch
+  // this way, the others wait for its slots otherwise.
+  void DecreaseBatchSize(int n = 1);
+  // Takes back a DecreaseBatchSize(), for threads that only search at times.
+  // Waits for a batch that is being forwarded, the slots of the thread may
+  // be written once it returns.
+  void IncreaseBatchSize(int n = 1);
 
   int MaxBatchSize() { return max_batch_size_; }
 
@@ -43,11 +54,16 @@ class NeuralNet {
 
   void *gpu_buffers_[kNumBuffers];
   float *host_buffers_[kNumBuffers];
+  std::vector<State::Record> records_;
   std::size_t sizes_[kNumBuffers];
   int max_batch_size_;
   int batch_size_;
   int soft_max_batch_size_;
   int buffer_index_;
+  // batches done so far, waiting threads leave once it changes
+  int generation_;
+  // a full batch is on the gpu, slots that are ready wait for the next one
+  bool forwarding_;
 
   int input_id_;
   int policy_id_;
@@ -55,4 +71,6 @@ class NeuralNet {
 
   // Performs actual forward inference on gpu, assumes batch is ready
   void Forward();
+  // Starts the next batch and wakes up the threads of this one
+  void Done();
 };
@@ -1,6 +1,7 @@
 #include "gpumanager.h"
 
 #include <glog/logging.h>
+#include <utils/random.h>
 #include <utils/safequeue.h>
 #include <iostream>
 
@@ -8,9 +9,12 @@ static constexpr int kNumThreads = 128;
 
 void Run(int tid, utils::SafeQueue<work_t> &q) {
   std::vector<output_t> v;
+  // a different position for every thread
+  utils::Random::Get().Seed(tid + 1);
+  State state;
   for (int i = 0; i < 800; i++) {
     work_t work;
-    work.planes = std::vector<float>(49*5*5, tid / float(kNumThreads));
+    state.Pack(work.record.data());
     work.result = std::make_shared<std::promise<output_t>>();
     q.Enqueue(work);
     auto x = work.result->get_future().get();
@@ -44,7 +44,12 @@ Random::Random() {
   std::uint64_t thread_id =
       std::hash<std::thread::id>()(std::this_thread::get_id());
   std::uint64_t seed = seed1 ^ seed2 ^ thread_id;
+  Seed(seed);
+}
+
+void Random::Seed(uint64_t seed) {
   rng_.seed(seed);
+  fast_.Seed(seed);
 }
 
 Random& Random::Get() {
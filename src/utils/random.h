@@ -33,9 +33,78 @@
 
 namespace utils {
 
+// the splitmix64 step of seed, different inputs give unrelated outputs
+inline uint64_t SplitMix64(uint64_t seed) {
+  uint64_t z = seed + 0x9e3779b97f4a7c15ull;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+// xoshiro256** by Blackman and Vigna, much smaller and faster than the
+// Mersenne twister. Good enough for games, not for cryptography.
+class Xoshiro256 {
+ public:
+  using result_type = uint64_t;
+
+  explicit Xoshiro256(uint64_t seed = 0) { Seed(seed); }
+
+  // expands the seed with splitmix64, every seed gives a valid state
+  void Seed(uint64_t seed) {
+    for (auto& s : s_) {
+      s = SplitMix64(seed);
+      seed += 0x9e3779b97f4a7c15ull;
+    }
+  }
+
+  uint64_t operator()() {
+    const uint64_t result = Rotl(s_[1] * 5, 7) * 9;
+    const uint64_t t = s_[1] << 17;
+    s_[2] ^= s_[0];
+    s_[3] ^= s_[1];
+    s_[1] ^= s_[2];
+    s_[0] ^= s_[3];
+    s_[2] ^= t;
+    s_[3] = Rotl(s_[3], 45);
+    return result;
+  }
+
+  // uniform in [0, n), Lemire's multiply and shift without division in the
+  // common case
+  uint64_t Bounded(uint64_t n) {
+    Wide m = static_cast<Wide>((*this)()) * n;
+    uint64_t low = static_cast<uint64_t>(m);
+    if (low < n) {
+      const uint64_t threshold = -n % n;
+      while (low < threshold) {
+        m = static_cast<Wide>((*this)()) * n;
+        low = static_cast<uint64_t>(m);
+      }
+    }
+    return static_cast<uint64_t>(m >> 64);
+  }
+
+  static constexpr uint64_t min() { return 0; }
+  static constexpr uint64_t max() { return ~0ull; }
+
+ private:
+  __extension__ typedef unsigned __int128 Wide;
+
+  static uint64_t Rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+  uint64_t s_[4];
+};
+
 class Random {
  public:
   static Random& Get();
+  // reseeds the generators of the calling thread, equal seeds give equal
+  // sequences
+  void Seed(uint64_t seed);
+  // uniform in [0, n), fast path for the game engine
+  uint64_t GetBounded(uint64_t n) { return fast_.Bounded(n); }
+  // the generator behind GetBounded()
+  Xoshiro256& Fast() { return fast_; }
   double GetDouble(double max_val);
   float GetFloat(float max_val);
   double GetGamma(double alpha, double beta);
@@ -49,6 +118,7 @@ class Random {
   Random();
 
   std::mt19937_64 rng_;
+  Xoshiro256 fast_;
 };
 
 }  // namespace utils